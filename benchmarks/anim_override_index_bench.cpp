@@ -0,0 +1,147 @@
+// AnimOverrideIndex against the nested unordered_map it replaced, on the lookup the animation hooks do
+// per morph: (refID, groupId, AnimCustom, firstPerson) to the active variant group, or nothing.
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "anim_override_index.h"
+#include "bench.h"
+
+namespace
+{
+	// AnimOverrideMap as it was before the flat index
+	struct OldSavedAnims
+	{
+		std::vector<std::string> anims;
+	};
+
+	struct OldAnimStacks
+	{
+		std::vector<OldSavedAnims> anims;
+		std::vector<OldSavedAnims> maleAnims;
+		std::vector<OldSavedAnims> femaleAnims;
+		std::vector<OldSavedAnims> hurtAnims;
+
+		std::vector<OldSavedAnims>& Get(AnimCustom custom)
+		{
+			switch (custom)
+			{
+			case AnimCustom::Male: return maleAnims;
+			case AnimCustom::Female: return femaleAnims;
+			case AnimCustom::Hurt: return hurtAnims;
+			default: return anims;
+			}
+		}
+	};
+
+	using OldAnimOverrideMap = std::unordered_map<UInt32, std::unordered_map<UInt32, OldAnimStacks>>;
+
+	struct Override
+	{
+		UInt32 refId;
+		UInt32 groupId;
+		AnimCustom custom;
+		bool firstPerson;
+	};
+
+	struct Query
+	{
+		Override key;
+		bool expectHit;
+	};
+
+	const OldSavedAnims* FindOld(OldAnimOverrideMap (&maps)[2], const Override& key)
+	{
+		auto& map = maps[key.firstPerson];
+		const auto mapIter = map.find(key.refId);
+		if (mapIter == map.end())
+			return nullptr;
+		const auto stacksIter = mapIter->second.find(key.groupId);
+		if (stacksIter == mapIter->second.end())
+			return nullptr;
+		auto& stack = stacksIter->second.Get(key.custom);
+		return stack.empty() ? nullptr : &stack.back();
+	}
+
+	const SavedAnims* FindNew(const AnimOverrideIndex& index, const Override& key)
+	{
+		const auto* stack = index.Find(key.refId, key.groupId, key.custom, key.firstPerson);
+		return stack && !stack->empty() ? &stack->back() : nullptr;
+	}
+
+	void Run(UInt32 numOverrides, UInt32 numQueries)
+	{
+		XorShift32 rng(numOverrides);
+		// overrides cluster on a few hundred groups of a set of refs, like weapon and actor overrides do
+		const UInt32 numRefs = numOverrides / 8 + 1;
+		std::vector<Override> overrides;
+		std::unordered_map<UInt64, bool> registered;
+		while (overrides.size() < numOverrides)
+		{
+			Override key{0x01000800 + rng.Next(numRefs), rng.Next(300), static_cast<AnimCustom>(rng.Next(8) == 0 ? 1 + rng.Next(3) : 0), rng.Next(4) == 0};
+			if (registered.emplace(MakeAnimOverrideKey(key.refId, key.groupId, key.custom, key.firstPerson), true).second)
+				overrides.push_back(key);
+		}
+
+		OldAnimOverrideMap oldMaps[2];
+		AnimOverrideIndex index;
+		for (const auto& key : overrides)
+		{
+			oldMaps[key.firstPerson][key.refId][key.groupId].Get(key.custom).push_back(OldSavedAnims{{"characters\\_male\\idle.kf"}});
+			SavedAnims anims;
+			anims.Add(0, 1);
+			index.Get(key.refId, key.groupId, key.custom, key.firstPerson).push_back(std::move(anims));
+		}
+		bench::Check(index.Size() == numOverrides, "every override got its own stack");
+
+		// half the queries miss, most morphs are of actors or groups nothing overrides
+		std::vector<Query> queries;
+		queries.reserve(numQueries);
+		for (UInt32 i = 0; i < numQueries; ++i)
+		{
+			if (rng.Next(2))
+			{
+				queries.push_back(Query{overrides[rng.Next(overrides.size())], true});
+				continue;
+			}
+			Override key{0x01000800 + rng.Next(numRefs * 2), rng.Next(300), AnimCustom::None, rng.Next(4) == 0};
+			queries.push_back(Query{key, registered.count(MakeAnimOverrideKey(key.refId, key.groupId, key.custom, key.firstPerson)) != 0});
+		}
+
+		for (const auto& query : queries)
+		{
+			bench::Check((FindOld(oldMaps, query.key) != nullptr) == query.expectHit, "nested map finds exactly the registered overrides");
+			bench::Check((FindNew(index, query.key) != nullptr) == query.expectHit, "flat index finds exactly the registered overrides");
+		}
+
+		const double oldNs = bench::NanosPerOp(numQueries, [&]
+		{
+			UInt64 found = 0;
+			for (const auto& query : queries)
+				found += FindOld(oldMaps, query.key) != nullptr;
+			bench::Consume(found);
+		});
+		const double newNs = bench::NanosPerOp(numQueries, [&]
+		{
+			UInt64 found = 0;
+			for (const auto& query : queries)
+				found += FindNew(index, query.key) != nullptr;
+			bench::Consume(found);
+		});
+		printf("%7u overrides: nested unordered_map %6.1f ns/lookup, AnimOverrideIndex %6.1f ns/lookup (%.2fx)\n",
+			numOverrides, oldNs, newNs, oldNs / newNs);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::ParseArgs(argc, argv);
+	if (bench::g_quick)
+	{
+		Run(1000, 10000);
+		return 0;
+	}
+	for (const UInt32 numOverrides : {10000u, 25000u, 50000u, 100000u})
+		Run(numOverrides, 1000000);
+	return 0;
+}
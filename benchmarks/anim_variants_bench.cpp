@@ -0,0 +1,167 @@
+// Weighted variant selection: checks that XorShift32 draws and SavedAnims alias table picks follow the
+// expected distributions, that seeded sequences replay, and times a pick against a linear scan over the
+// cumulative weights.
+#include <cmath>
+#include <vector>
+
+#include "anim_variants.h"
+#include "bench.h"
+
+namespace
+{
+	// Pearson's chi-squared statistic of observed counts against expected probabilities
+	double ChiSquared(const std::vector<UInt64>& counts, const std::vector<double>& probs, UInt64 numDraws)
+	{
+		double result = 0;
+		for (size_t i = 0; i < counts.size(); ++i)
+		{
+			const double expected = probs[i] * numDraws;
+			if (expected == 0)
+			{
+				bench::Check(counts[i] == 0, "outcomes of probability 0 are never drawn");
+				continue;
+			}
+			result += (counts[i] - expected) * (counts[i] - expected) / expected;
+		}
+		return result;
+	}
+
+	// upper 0.1% point of the chi-squared distribution with dof degrees of freedom (Wilson-Hilferty)
+	double ChiSquaredCritical(UInt32 dof)
+	{
+		const double z = 3.090;
+		const double k = dof;
+		const double t = 1 - 2 / (9 * k) + z * std::sqrt(2 / (9 * k));
+		return k * t * t * t;
+	}
+
+	SavedAnims MakeAnims(const std::vector<float>& weights)
+	{
+		SavedAnims anims;
+		for (UInt32 i = 0; i < weights.size(); ++i)
+			anims.Add(i, weights[i]);
+		return anims;
+	}
+
+	void CheckUniform(UInt32 n, UInt64 numDraws)
+	{
+		XorShift32 rng(n * 7919);
+		std::vector<UInt64> counts(n);
+		for (UInt64 i = 0; i < numDraws; ++i)
+			++counts[rng.Next(n)];
+		const double chi = ChiSquared(counts, std::vector<double>(n, 1.0 / n), numDraws);
+		printf("XorShift32::Next(%u): chi^2 %.2f, 0.1%% critical value %.2f\n", n, chi, ChiSquaredCritical(n - 1));
+		bench::Check(chi < ChiSquaredCritical(n - 1), "XorShift32::Next(n) is uniform");
+	}
+
+	void CheckWeighted(const std::vector<float>& weights, UInt64 numDraws)
+	{
+		const auto anims = MakeAnims(weights);
+		double total = 0;
+		for (const auto weight : weights)
+			total += weight;
+		std::vector<double> probs;
+		UInt32 dof = 0;
+		for (const auto weight : weights)
+		{
+			probs.push_back(total > 0 ? weight / total : 1.0 / weights.size());
+			dof += probs.back() > 0;
+		}
+
+		XorShift32 rng(static_cast<UInt32>(weights.size()) * 104729);
+		std::vector<UInt64> counts(weights.size());
+		for (UInt64 i = 0; i < numDraws; ++i)
+			++counts[anims.Pick(rng)];
+		const double chi = ChiSquared(counts, probs, numDraws);
+		printf("alias table over %zu weights: chi^2 %.2f, 0.1%% critical value %.2f\n", weights.size(), chi, ChiSquaredCritical(dof - 1));
+		bench::Check(chi < ChiSquaredCritical(dof - 1), "alias table picks follow the weights");
+	}
+
+	void CheckReplay()
+	{
+		const auto anims = MakeAnims({1, 5, 2, 0, 3});
+		XorShift32 a(1234), b(1234), c(4321);
+		bool differs = false;
+		for (int i = 0; i < 1000; ++i)
+		{
+			const auto pick = anims.Pick(a);
+			bench::Check(pick == anims.Pick(b), "the same seed replays the same picks");
+			differs |= pick != anims.Pick(c);
+		}
+		bench::Check(differs, "different seeds give different picks");
+		bench::Check(XorShift32(0).state != 0, "seed 0 doesn't lock the generator at 0");
+	}
+
+	void CheckWeightSuffix()
+	{
+		bench::Check(GetAnimWeight(g_animPathPool.Intern("characters\\_male\\attack_2_w3.kf")) == 3, "_w3 suffix weighs 3");
+		bench::Check(GetAnimWeight(g_animPathPool.Intern("characters\\_male\\attack_2.kf")) == 1, "no suffix weighs 1");
+		bench::Check(GetAnimWeight(g_animPathPool.Intern("characters\\_male\\attack_w.kf")) == 1, "suffix without a number weighs 1");
+		const auto path = g_animPathPool.Intern("characters\\_male\\attack_3_w2.kf");
+		SetAnimWeight(path, 7);
+		bench::Check(GetAnimWeight(path) == 7, "SetAnimWeight overrides the suffix");
+		SetAnimWeight(path, -1);
+		bench::Check(GetAnimWeight(path) == 0, "negative weights clamp to 0");
+	}
+
+	// what selection costs without an alias table: draw a point in the total weight and scan for it
+	UInt32 PickLinear(const std::vector<float>& cumulative, XorShift32& rng)
+	{
+		const float point = rng.NextFloat() * cumulative.back();
+		UInt32 i = 0;
+		while (i + 1 < cumulative.size() && cumulative[i] <= point)
+			++i;
+		return i;
+	}
+
+	void Benchmark(UInt32 numVariants)
+	{
+		XorShift32 weightRng(numVariants);
+		std::vector<float> weights, cumulative;
+		for (UInt32 i = 0; i < numVariants; ++i)
+		{
+			weights.push_back(1.0F + weightRng.Next(9));
+			cumulative.push_back((cumulative.empty() ? 0 : cumulative.back()) + weights.back());
+		}
+		const auto anims = MakeAnims(weights);
+		const UInt32 numPicks = 10000000;
+
+		XorShift32 rng;
+		const double aliasNs = bench::NanosPerOp(numPicks, [&]
+		{
+			UInt64 sum = 0;
+			for (UInt32 i = 0; i < numPicks; ++i)
+				sum += anims.Pick(rng);
+			bench::Consume(sum);
+		});
+		const double linearNs = bench::NanosPerOp(numPicks, [&]
+		{
+			UInt64 sum = 0;
+			for (UInt32 i = 0; i < numPicks; ++i)
+				sum += PickLinear(cumulative, rng);
+			bench::Consume(sum);
+		});
+		printf("%3u variants: alias table %5.2f ns/pick, cumulative scan %6.2f ns/pick\n", numVariants, aliasNs, linearNs);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::ParseArgs(argc, argv);
+	const UInt64 numDraws = bench::g_quick ? 200000 : 10000000;
+
+	for (const UInt32 n : {2u, 3u, 7u, 10u, 64u})
+		CheckUniform(n, numDraws);
+	CheckWeighted({1, 2, 3, 4}, numDraws);
+	CheckWeighted({0, 1, 0, 5}, numDraws);
+	CheckWeighted({0, 0, 0}, numDraws);
+	CheckWeighted({100, 1, 1, 1, 1, 1, 1, 1}, numDraws);
+	CheckWeighted({0.25F, 3, 7.5F, 1, 1, 12, 0.5F, 2, 9, 4, 4, 6, 1, 1, 3, 8}, numDraws);
+	CheckReplay();
+	CheckWeightSuffix();
+
+	if (!bench::g_quick)
+		for (const UInt32 n : {2u, 4u, 16u, 64u})
+			Benchmark(n);
+	return 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Shared by the host benchmarks. Each one is a single executable that exits with 1 on the first failed
+// check, --quick shrinks the inputs so that ctest only checks results.
+namespace bench
+{
+	inline bool g_quick = false;
+
+	inline void ParseArgs(int argc, char** argv)
+	{
+		for (int i = 1; i < argc; ++i)
+			if (!strcmp(argv[i], "--quick"))
+				g_quick = true;
+	}
+
+	inline void Check(bool condition, const char* what)
+	{
+		if (condition)
+			return;
+		printf("FAILED: %s\n", what);
+		exit(1);
+	}
+
+	// keeps the compiler from dropping a result that is otherwise unused
+	inline volatile UInt64 g_sink;
+
+	inline void Consume(UInt64 value)
+	{
+		g_sink = g_sink + value;
+	}
+
+	// xorshift32, for benchmarks that don't link the plugin's XorShift32
+	struct Rng
+	{
+		UInt32 state;
+
+		explicit Rng(UInt32 seed = 0x2545F491) : state(seed ? seed : 0x2545F491) {}
+
+		UInt32 Next()
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		// uniform in [0, n)
+		UInt32 Next(UInt32 n)
+		{
+			return static_cast<UInt32>(static_cast<UInt64>(Next()) * n >> 32);
+		}
+	};
+
+	class Timer
+	{
+		std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+	public:
+		double Nanoseconds() const
+		{
+			return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_).count();
+		}
+	};
+
+	// time per operation of the fastest of a few runs, each run doing numOps operations
+	template <typename F>
+	double NanosPerOp(UInt32 numOps, F&& run)
+	{
+		double best = 1e300;
+		for (int i = 0; i < (g_quick ? 1 : 5); ++i)
+		{
+			Timer timer;
+			run();
+			const double elapsed = timer.Nanoseconds() / numOps;
+			if (elapsed < best)
+				best = elapsed;
+		}
+		return best;
+	}
+}
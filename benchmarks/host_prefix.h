@@ -0,0 +1,12 @@
+#pragma once
+// The fixed width types the game build gets from common/ITypes.h through its precompiled header
+#include <cstdint>
+
+typedef std::uint8_t	UInt8;
+typedef std::uint16_t	UInt16;
+typedef std::uint32_t	UInt32;
+typedef std::uint64_t	UInt64;
+typedef std::int8_t		SInt8;
+typedef std::int16_t	SInt16;
+typedef std::int32_t	SInt32;
+typedef std::int64_t	SInt64;
@@ -0,0 +1,183 @@
+// Hit rate of the per-thread VarMap lookup cache at 1 to 16 entries, replaying a lookup trace. Pass a
+// VarLookups.txt recorded with TRACE_VAR_LOOKUPS set in VarMap.h, without one a synthetic trace of scripts
+// cycling through a few arrays each is replayed.
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "VarMapCache.h"
+#include "bench.h"
+
+namespace
+{
+	struct TraceEntry
+	{
+		UInt32 map;
+		UInt32 thread;
+		bool isDelete;
+		UInt32 varID;
+	};
+
+	std::vector<TraceEntry> LoadTrace(const char* path)
+	{
+		std::vector<TraceEntry> trace;
+		FILE* file = fopen(path, "r");
+		if (!file)
+			return trace;
+		std::map<std::string, UInt32> maps;
+		std::map<unsigned long, UInt32> threads;
+		char mapName[32], op;
+		unsigned long thread, varID;
+		while (fscanf(file, "%31s %lu %c %lu", mapName, &thread, &op, &varID) == 4)
+		{
+			const auto map = maps.emplace(mapName, maps.size()).first->second;
+			const auto threadIdx = threads.emplace(thread, threads.size()).first->second;
+			trace.push_back(TraceEntry{map, threadIdx, op == 'D', static_cast<UInt32>(varID)});
+		}
+		fclose(file);
+		return trace;
+	}
+
+	// scripts on a few threads, each one run touching its own handful of arrays in random order and now
+	// and then deleting a temporary array, which drops the caches of every thread
+	std::vector<TraceEntry> MakeSyntheticTrace(UInt32 numRuns)
+	{
+		struct Script
+		{
+			UInt32 thread;
+			std::vector<UInt32> arrays;
+		};
+		bench::Rng rng(2024);
+		std::vector<Script> scripts(200);
+		UInt32 nextID = 1;
+		for (auto& script : scripts)
+		{
+			script.thread = rng.Next(8) == 0 ? 1 + rng.Next(3) : 0;
+			for (UInt32 i = 0, n = 1 + rng.Next(6); i < n; ++i)
+				script.arrays.push_back(nextID++);
+		}
+
+		std::vector<TraceEntry> trace;
+		for (UInt32 run = 0; run < numRuns; ++run)
+		{
+			const auto& script = scripts[rng.Next(scripts.size())];
+			for (UInt32 i = 0, n = 4 + rng.Next(40); i < n; ++i)
+				trace.push_back(TraceEntry{0, script.thread, false, script.arrays[rng.Next(script.arrays.size())]});
+			if (rng.Next(10) == 0)
+			{
+				const auto temp = nextID++;
+				trace.push_back(TraceEntry{0, script.thread, false, temp});
+				trace.push_back(TraceEntry{0, script.thread, true, temp});
+			}
+		}
+		return trace;
+	}
+
+	struct Result
+	{
+		UInt64 hits = 0;
+		UInt64 lookups = 0;
+		UInt64 drops = 0;
+	};
+
+	// replays the trace the way VarMap::Get and VarMap::Delete use the caches
+	template <UInt32 NumEntries>
+	Result Replay(const std::vector<TraceEntry>& trace)
+	{
+		using Cache = VarMapCache<int, NumEntries>;
+		std::map<std::pair<UInt32, UInt32>, Cache> caches;
+		std::map<UInt32, UInt32> generations;
+		int var = 0;
+		Result result;
+		for (const auto& entry : trace)
+		{
+			auto& generation = generations[entry.map];
+			if (entry.isDelete)
+			{
+				++generation;
+				continue;
+			}
+			auto& cache = caches[{entry.map, entry.thread}];
+			// a cache per thread and map type, told apart by owner, so the key stands in for the map
+			if (!cache.Validate(reinterpret_cast<const void*>(static_cast<size_t>(entry.map) + 1), generation))
+				VarCacheStats::Add(cache.stats.drops);
+			if (cache.Get(entry.varID))
+				VarCacheStats::Add(cache.stats.hits);
+			else
+			{
+				VarCacheStats::Add(cache.stats.misses);
+				cache.Insert(entry.varID, &var);
+			}
+		}
+		for (const auto& [key, cache] : caches)
+		{
+			result.hits += cache.stats.hits;
+			result.lookups += cache.stats.hits + cache.stats.misses;
+			result.drops += cache.stats.drops;
+		}
+		return result;
+	}
+
+	template <UInt32 NumEntries>
+	void Report(const std::vector<TraceEntry>& trace)
+	{
+		const auto result = Replay<NumEntries>(trace);
+		printf("%2u entries: %5.1f%% hits, %llu cache drops\n", NumEntries,
+			result.lookups ? 100.0 * result.hits / result.lookups : 0.0, static_cast<unsigned long long>(result.drops));
+	}
+
+	void CheckCache()
+	{
+		// a script alternating between three arrays thrashes a single entry but not eight
+		std::vector<TraceEntry> trace;
+		for (UInt32 i = 0; i < 300; ++i)
+			trace.push_back(TraceEntry{0, 0, false, 1 + i % 3});
+		bench::Check(Replay<1>(trace).hits == 0, "one entry misses on three alternating arrays");
+		bench::Check(Replay<8>(trace).hits == 297, "eight entries only miss the first use of each array");
+
+		// nine arrays in turn evict each other round robin
+		trace.clear();
+		for (UInt32 i = 0; i < 90; ++i)
+			trace.push_back(TraceEntry{0, 0, false, 1 + i % 9});
+		bench::Check(Replay<8>(trace).hits == 0, "round robin evicts the least recently inserted entry");
+
+		// deleting any var drops the caches of every thread on that map, other maps keep theirs
+		trace = {{0, 0, false, 1}, {0, 1, false, 1}, {1, 0, false, 1}, {0, 2, true, 7},
+			{0, 0, false, 1}, {0, 1, false, 1}, {1, 0, false, 1}};
+		const auto result = Replay<8>(trace);
+		bench::Check(result.hits == 1 && result.drops == 5, "deletes drop the caches of their map only");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::ParseArgs(argc, argv);
+	CheckCache();
+	if (bench::g_quick)
+		return 0;
+
+	std::vector<TraceEntry> trace;
+	const char* path = nullptr;
+	for (int i = 1; i < argc; ++i)
+		if (argv[i][0] != '-')
+			path = argv[i];
+	if (path)
+	{
+		trace = LoadTrace(path);
+		bench::Check(!trace.empty(), "the trace file can be read and isn't empty");
+		printf("%s: %zu entries\n", path, trace.size());
+	}
+	else
+	{
+		trace = MakeSyntheticTrace(200000);
+		printf("synthetic trace: %zu entries\n", trace.size());
+	}
+	Report<1>(trace);
+	Report<2>(trace);
+	Report<4>(trace);
+	Report<8>(trace);
+	Report<16>(trace);
+	return 0;
+}
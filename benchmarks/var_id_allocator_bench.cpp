@@ -0,0 +1,194 @@
+// VarIDAllocator: checks it against a reference model under random create / delete / temporary churn and
+// times that churn at 100k+ live vars against the sorted ID sets VarMap used before it.
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+
+#include "VarIDAllocator.h"
+#include "bench.h"
+
+namespace
+{
+	// Set<UInt32> as VarMap used it: a sorted array, inserting and erasing move everything behind the key
+	struct SortedIDs
+	{
+		std::vector<UInt32> keys;
+
+		void Insert(UInt32 key)
+		{
+			const auto iter = std::lower_bound(keys.begin(), keys.end(), key);
+			if (iter == keys.end() || *iter != key)
+				keys.insert(iter, key);
+		}
+
+		void Erase(UInt32 key)
+		{
+			const auto iter = std::lower_bound(keys.begin(), keys.end(), key);
+			if (iter != keys.end() && *iter == key)
+				keys.erase(iter);
+		}
+
+		UInt32 PopFirst()
+		{
+			const UInt32 first = keys.front();
+			keys.erase(keys.begin());
+			return first;
+		}
+	};
+
+	// usedIDs / tempIDs / availableIDs of the old VarMap, with the same calls VarIDAllocator gets
+	struct OldVarIDs
+	{
+		SortedIDs usedIDs;
+		SortedIDs tempIDs;
+		SortedIDs availableIDs;
+
+		UInt32 Allocate()
+		{
+			UInt32 id = 1;
+			if (!availableIDs.keys.empty())
+				id = availableIDs.PopFirst();
+			else if (!usedIDs.keys.empty())
+				id = usedIDs.keys.back() + 1;
+			usedIDs.Insert(id);
+			return id;
+		}
+
+		void Release(UInt32 id)
+		{
+			usedIDs.Erase(id);
+			tempIDs.Erase(id);
+			availableIDs.Insert(id);
+		}
+
+		void SetTemporary(UInt32 id, bool bTemporary)
+		{
+			if (bTemporary)
+				tempIDs.Insert(id);
+			else
+				tempIDs.Erase(id);
+		}
+	};
+
+	// delete a random live var, then create one the way a script does: temporary until assigned to a variable
+	template <typename IDs>
+	void Churn(IDs& ids, std::vector<UInt32>& live, UInt32 numOps, bench::Rng& rng)
+	{
+		for (UInt32 i = 0; i < numOps; ++i)
+		{
+			auto& slot = live[rng.Next(live.size())];
+			ids.SetTemporary(slot, false);
+			ids.Release(slot);
+			slot = ids.Allocate();
+			ids.SetTemporary(slot, true);
+			ids.SetTemporary(slot, false);
+		}
+	}
+
+	template <typename IDs>
+	void Fill(IDs& ids, std::vector<UInt32>& live, UInt32 numLive)
+	{
+		live.clear();
+		for (UInt32 i = 0; i < numLive; ++i)
+			live.push_back(ids.Allocate());
+	}
+
+	void CheckAgainstModel(UInt32 numOps)
+	{
+		VarIDAllocator ids;
+		std::unordered_set<UInt32> used, temps, released;
+		std::vector<UInt32> live;
+		bench::Rng rng(42);
+		UInt32 highest = 0;
+		for (UInt32 i = 0; i < numOps; ++i)
+		{
+			const auto action = rng.Next(10);
+			if (action < 4 || live.empty())
+			{
+				const auto id = ids.Allocate();
+				bench::Check(id != 0, "0 is never handed out");
+				bench::Check(!used.count(id), "allocated IDs are not in use");
+				bench::Check(released.empty() ? id == highest + 1 : released.count(id) != 0, "allocation reuses released IDs before new ones");
+				released.erase(id);
+				used.insert(id);
+				live.push_back(id);
+				highest = std::max(highest, id);
+			}
+			else if (action < 7)
+			{
+				const auto idx = rng.Next(live.size());
+				const auto id = live[idx];
+				live[idx] = live.back();
+				live.pop_back();
+				ids.SetTemporary(id, false);
+				ids.Release(id);
+				ids.Release(id); // released twice, as deleting an already deleted var does
+				used.erase(id);
+				temps.erase(id);
+				released.insert(id);
+			}
+			else if (action < 9)
+			{
+				const auto id = live[rng.Next(live.size())];
+				const bool temporary = rng.Next(2);
+				ids.SetTemporary(id, temporary);
+				if (temporary)
+					temps.insert(id);
+				else
+					temps.erase(id);
+			}
+			else
+			{
+				// loading a save claims the IDs it stored, released or never seen
+				const auto id = 1 + rng.Next(highest + 100);
+				if (used.count(id))
+					continue;
+				// IDs skipped over are never handed out, like the old sets did
+				ids.Claim(id);
+				released.erase(id);
+				used.insert(id);
+				live.push_back(id);
+				highest = std::max(highest, id);
+			}
+
+			bench::Check(ids.HasTemporary() == !temps.empty(), "HasTemporary matches the temporary IDs");
+			if (!temps.empty())
+				bench::Check(temps.count(ids.LastTemporary()) != 0, "LastTemporary is a temporary ID");
+		}
+		for (const auto id : live)
+			bench::Check(ids.IsTemporary(id) == (temps.count(id) != 0), "IsTemporary matches the temporary IDs");
+
+		ids.Clear();
+		bench::Check(ids.Allocate() == 1 && !ids.HasTemporary(), "Clear starts over at 1");
+	}
+
+	void Benchmark(UInt32 numLive)
+	{
+		const UInt32 numOps = 200000;
+		const UInt32 numOldOps = 5000;	// each one moves megabytes at these sizes
+		std::vector<UInt32> live;
+
+		VarIDAllocator ids;
+		Fill(ids, live, numLive);
+		bench::Rng rng(numLive);
+		const double newNs = bench::NanosPerOp(numOps, [&] { Churn(ids, live, numOps, rng); });
+
+		OldVarIDs oldIDs;
+		Fill(oldIDs, live, numLive);
+		rng = bench::Rng(numLive);
+		const double oldNs = bench::NanosPerOp(numOldOps, [&] { Churn(oldIDs, live, numOldOps, rng); });
+
+		printf("%7u live vars: sorted ID sets %8.1f ns/churn, VarIDAllocator %5.1f ns/churn (%.0fx)\n",
+			numLive, oldNs, newNs, oldNs / newNs);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::ParseArgs(argc, argv);
+	CheckAgainstModel(bench::g_quick ? 20000 : 1000000);
+	if (!bench::g_quick)
+		for (const UInt32 numLive : {10000u, 100000u, 250000u, 500000u})
+			Benchmark(numLive);
+	return 0;
+}
@@ -2,6 +2,7 @@
 #include "ArrayVar.h"
 #include "GameForms.h"
 #include <algorithm>
+#include <functional>
 #include <intrin.h>
 
 #if RUNTIME
@@ -380,7 +381,7 @@ thread_local ArrayKey s_arrNumKey(kDataType_Numeric), s_arrStrKey(kDataType_Stri
 //////////////////////
 
 ArrayVar::ArrayVar(UInt32 _keyType, bool _packed, UInt8 modIndex) : m_ID(0), m_keyType(_keyType), m_bPacked(_packed),
-                                                                    m_owningModIndex(modIndex)
+                                                                    m_owningModIndex(modIndex), m_serial(0)
 {
 	if (m_keyType == kDataType_String)
 		m_elements.m_type = kContainer_StringMap;
@@ -400,6 +401,7 @@ ArrayElement* ArrayVar::Get(const ArrayKey* key, bool bCanCreateNew)
 	default:
 	case kContainer_Array:
 		{
+			Unpack();
 			auto* pArray = m_elements.getArrayPtr();
 			int idx = key->key.num;
 			if (idx < 0)
@@ -447,6 +449,7 @@ ArrayElement* ArrayVar::Get(double key, bool bCanCreateNew)
 	default:
 	case kContainer_Array:
 		{
+			Unpack();
 			auto* pArray = m_elements.getArrayPtr();
 			int idx = key;
 			if (idx < 0)
@@ -488,8 +491,51 @@ ArrayElement* ArrayVar::Get(const char* key, bool bCanCreateNew)
 	return pMap->GetPtr(const_cast<char*>(key));
 }
 
+bool ArrayVar::PackAs(DataType type)
+{
+	if (GetContainerType() != kContainer_Array)
+		return false;
+	if (m_elements.getPackedType() == type)
+		return true;
+	if (!m_elements.empty())
+		return false;
+	Unpack();
+	return m_elements.pack(type);
+}
+
+UInt32 ArrayVar::PackedIndex(double key) const
+{
+	int idx = key;
+	if (idx < 0)
+		idx += Size();
+	return ((UInt32)idx < Size()) ? idx : -1;
+}
+
+void ArrayVar::GetPackedElement(UInt32 index, ArrayElement* out) const
+{
+	if (m_elements.getPackedType() == kDataType_Numeric)
+		out->SetNumber((*m_elements.getNumbersPtr())[index]);
+	else
+		out->SetFormID((*m_elements.getFormsPtr())[index]);
+}
+
+// same indexing as Get(): negative keys count from the end, keys past the end append
+template <typename T>
+static void SetPackedValue(Vector<T>* values, double key, T value)
+{
+	int idx = key;
+	if (idx < 0)
+		idx += values->Size();
+	if (T* pValue = values->GetPtr((UInt32)idx))
+		*pValue = value;
+	else
+		values->Append(value);
+}
+
 bool ArrayVar::HasKey(double key)
 {
+	if (m_elements.getPackedType() != kDataType_Invalid)
+		return PackedIndex(key) != -1;
 	return Get(key, false) != NULL;
 }
 
@@ -500,17 +546,29 @@ bool ArrayVar::HasKey(const char* key)
 
 bool ArrayVar::HasKey(const ArrayKey* key)
 {
+	if (m_elements.getPackedType() != kDataType_Invalid)
+		return (key->KeyType() == kDataType_Numeric) && (PackedIndex(key->key.num) != -1);
 	return Get(key, false) != NULL;
 }
 
 bool ArrayVar::SetElementNumber(double key, double num)
 {
+	if (PackAs(kDataType_Numeric))
+	{
+		SetPackedValue(m_elements.getNumbersPtr(), key, num);
+		return true;
+	}
 	ArrayElement* elem = Get(key, true);
 	if (!elem) return false;
 	elem->SetNumber(num);
 	return true;
 }
 
+bool ArrayVar::SetElementNumber(const ArrayKey* key, double num)
+{
+	return (key->KeyType() == kDataType_Numeric) ? SetElementNumber(key->key.num, num) : SetElementNumber(key->key.GetStr(), num);
+}
+
 bool ArrayVar::SetElementNumber(const char* key, double num)
 {
 	ArrayElement* elem = Get(key, true);
@@ -537,6 +595,11 @@ bool ArrayVar::SetElementString(const char* key, const char* str)
 
 bool ArrayVar::SetElementFormID(double key, UInt32 refID)
 {
+	if (PackAs(kDataType_Form))
+	{
+		SetPackedValue(m_elements.getFormsPtr(), key, refID);
+		return true;
+	}
 	ArrayElement* elem = Get(key, true);
 	if (!elem) return false;
 	elem->SetFormID(refID);
@@ -569,6 +632,10 @@ bool ArrayVar::SetElementArray(const char* key, ArrayID srcID)
 
 bool ArrayVar::SetElement(double key, const ArrayElement* val)
 {
+	if (val->DataType() == kDataType_Numeric)
+		return SetElementNumber(key, val->m_data.num);
+	if (val->DataType() == kDataType_Form)
+		return SetElementFormID(key, val->m_data.formID);
 	ArrayElement* elem = Get(key, true);
 	if (!elem) return false;
 	elem->Set(val);
@@ -585,7 +652,9 @@ bool ArrayVar::SetElement(const char* key, const ArrayElement* val)
 
 bool ArrayVar::SetElement(const ArrayKey* key, const ArrayElement* val)
 {
-	ArrayElement* elem = (key->KeyType() == kDataType_Numeric) ? Get(key->key.num, true) : Get(key->key.GetStr(), true);
+	if (key->KeyType() == kDataType_Numeric)
+		return SetElement(key->key.num, val);
+	ArrayElement* elem = Get(key->key.GetStr(), true);
 	if (!elem) return false;
 	elem->Set(val);
 	return true;
@@ -593,6 +662,10 @@ bool ArrayVar::SetElement(const ArrayKey* key, const ArrayElement* val)
 
 bool ArrayVar::SetElementFromAPI(double key, const NVSEArrayVarInterface::Element* srcElem)
 {
+	if (srcElem->type == NVSEArrayVarInterface::Element::kType_Numeric)
+		return SetElementNumber(key, srcElem->num);
+	if (srcElem->type == NVSEArrayVarInterface::Element::kType_Form)
+		return SetElementFormID(key, srcElem->form ? srcElem->form->refID : 0);
 	ArrayElement* elem = Get(key, true);
 	if (!elem) return false;
 	switch (srcElem->type)
@@ -643,27 +716,44 @@ bool ArrayVar::SetElementFromAPI(const char* key, const NVSEArrayVarInterface::E
 
 bool ArrayVar::GetElementNumber(const ArrayKey* key, double* out)
 {
+	if (m_elements.getPackedType() != kDataType_Invalid)
+	{
+		UInt32 idx = (key->KeyType() == kDataType_Numeric) ? PackedIndex(key->key.num) : -1;
+		if ((idx == -1) || (m_elements.getPackedType() != kDataType_Numeric))
+			return false;
+		*out = (*m_elements.getNumbersPtr())[idx];
+		return true;
+	}
 	ArrayElement* elem = Get(key, false);
 	return (elem && elem->GetAsNumber(out));
 }
 
 bool ArrayVar::GetElementString(const ArrayKey* key, const char** out)
 {
+	if (m_elements.getPackedType() != kDataType_Invalid)
+		return false;
 	ArrayElement* elem = Get(key, false);
 	return (elem && elem->GetAsString(out));
 }
 
 bool ArrayVar::GetElementFormID(const ArrayKey* key, UInt32* out)
 {
+	if (m_elements.getPackedType() != kDataType_Invalid)
+	{
+		UInt32 idx = (key->KeyType() == kDataType_Numeric) ? PackedIndex(key->key.num) : -1;
+		if ((idx == -1) || (m_elements.getPackedType() != kDataType_Form))
+			return false;
+		*out = (*m_elements.getFormsPtr())[idx];
+		return true;
+	}
 	ArrayElement* elem = Get(key, false);
 	return (elem && elem->GetAsFormID(out));
 }
 
 bool ArrayVar::GetElementForm(const ArrayKey* key, TESForm** out)
 {
-	ArrayElement* elem = Get(key, false);
 	UInt32 refID;
-	if (elem && elem->GetAsFormID(&refID))
+	if (GetElementFormID(key, &refID))
 	{
 		*out = LookupFormByID(refID);
 		return true;
@@ -673,12 +763,16 @@ bool ArrayVar::GetElementForm(const ArrayKey* key, TESForm** out)
 
 bool ArrayVar::GetElementArray(const ArrayKey* key, ArrayID* out)
 {
+	if (m_elements.getPackedType() != kDataType_Invalid)
+		return false;
 	ArrayElement* elem = Get(key, false);
 	return (elem && elem->GetAsArray(out));
 }
 
 DataType ArrayVar::GetElementType(const ArrayKey* key)
 {
+	if (m_elements.getPackedType() != kDataType_Invalid)
+		return HasKey(key) ? m_elements.getPackedType() : kDataType_Invalid;
 	ArrayElement* elem = Get(key, false);
 	return elem ? elem->DataType() : kDataType_Invalid;
 }
@@ -692,8 +786,7 @@ const ArrayKey* ArrayVar::Find(const ArrayElement* toFind, const Slice* range)
 	default:
 	case kContainer_Array:
 		{
-			ElementVector* pArray = m_elements.getArrayPtr();
-			UInt32 arrSize = pArray->Size(), iLow, iHigh;
+			UInt32 arrSize = Size(), iLow, iHigh;
 			if (range)
 			{
 				if (range->bIsString)
@@ -710,7 +803,27 @@ const ArrayKey* ArrayVar::Find(const ArrayElement* toFind, const Slice* range)
 				iLow = 0;
 				iHigh = arrSize - 1;
 			}
-			ArrayElement* elements = pArray->Data();
+			if (DataType packedType = m_elements.getPackedType())
+			{
+				if (toFind->DataType() != packedType)
+					return NULL;
+				UInt32 idx = iHigh + 1;
+				if (packedType == kDataType_Numeric)
+				{
+					double* numbers = m_elements.getNumbersPtr()->Data();
+					idx = std::find(numbers + iLow, numbers + iHigh + 1, toFind->m_data.num) - numbers;
+				}
+				else
+				{
+					UInt32* forms = m_elements.getFormsPtr()->Data();
+					idx = std::find(forms + iLow, forms + iHigh + 1, toFind->m_data.formID) - forms;
+				}
+				if (idx > iHigh)
+					return NULL;
+				s_arrNumKey.key.num = (int)idx;
+				return &s_arrNumKey;
+			}
+			ArrayElement* elements = m_elements.getArrayPtr()->Data();
 			for (int idx = iLow; idx <= iHigh; idx++)
 			{
 				if (elements[idx] != *toFind) continue;
@@ -789,10 +902,26 @@ const ArrayKey* ArrayVar::Find(const ArrayElement* toFind, const Slice* range)
 	}
 }
 
+// elements of packed arrays are handed out as a per thread copy, overwritten by the next call
+thread_local ArrayElement s_packedElem;
+
+bool ArrayVar::GetPackedElement(UInt32 index, ArrayElement** outElem, const ArrayKey** outKey)
+{
+	if (index >= Size())
+		return false;
+	GetPackedElement(index, &s_packedElem);
+	s_arrNumKey.key.num = (int)index;
+	*outElem = &s_packedElem;
+	*outKey = &s_arrNumKey;
+	return true;
+}
+
 bool ArrayVar::GetFirstElement(ArrayElement** outElem, const ArrayKey** outKey)
 {
 	if (Empty()) return false;
 
+	if (m_elements.getPackedType() != kDataType_Invalid)
+		return GetPackedElement(0, outElem, outKey);
 	ArrayIterator iter = m_elements.begin();
 	*outKey = iter.first();
 	*outElem = iter.second();
@@ -803,6 +932,8 @@ bool ArrayVar::GetLastElement(ArrayElement** outElem, const ArrayKey** outKey)
 {
 	if (Empty()) return false;
 
+	if (m_elements.getPackedType() != kDataType_Invalid)
+		return GetPackedElement(Size() - 1, outElem, outKey);
 	ArrayIterator iter = m_elements.rbegin();
 	*outKey = iter.first();
 	*outElem = iter.second();
@@ -814,6 +945,11 @@ bool ArrayVar::GetNextElement(const ArrayKey* prevKey, ArrayElement** outElem, c
 	if (!prevKey || Empty())
 		return false;
 
+	if (m_elements.getPackedType() != kDataType_Invalid)
+	{
+		UInt32 idx = (int)prevKey->key.num;
+		return (prevKey->KeyType() == kDataType_Numeric) && (idx < Size()) && GetPackedElement(idx + 1, outElem, outKey);
+	}
 	ArrayIterator iter = m_elements.find(prevKey);
 	if (!iter.End())
 	{
@@ -833,6 +969,11 @@ bool ArrayVar::GetPrevElement(const ArrayKey* prevKey, ArrayElement** outElem, c
 	if (!prevKey || Empty())
 		return false;
 
+	if (m_elements.getPackedType() != kDataType_Invalid)
+	{
+		UInt32 idx = (int)prevKey->key.num;
+		return (prevKey->KeyType() == kDataType_Numeric) && (idx < Size()) && GetPackedElement(idx - 1, outElem, outKey);
+	}
 	ArrayIterator iter = m_elements.find(prevKey);
 	if (!iter.End())
 	{
@@ -891,6 +1032,7 @@ bool ArrayVar::SetSize(UInt32 newSize, const ArrayElement* padWith)
 bool ArrayVar::Insert(UInt32 atIndex, const ArrayElement* toInsert)
 {
 	if (!m_bPacked) return false;
+	Unpack();
 	auto* pVec = m_elements.getArrayPtr();
 	UInt32 varSize = pVec->Size();
 	if (atIndex > varSize) return false;
@@ -906,6 +1048,8 @@ bool ArrayVar::Insert(UInt32 atIndex, ArrayID rangeID)
 	if (!m_bPacked || !src || !src->m_bPacked)
 		return false;
 
+	Unpack();
+	src->Unpack();
 	auto *pDest = m_elements.getArrayPtr(), *pSrc = src->m_elements.getArrayPtr();
 	UInt32 destSize = pDest->Size();
 	if (atIndex > destSize)
@@ -930,6 +1074,13 @@ ArrayVar* ArrayVar::GetKeys(UInt8 modIndex)
 	ArrayVar* keysArr = g_ArrayMap.Create(kDataType_Numeric, true, modIndex);
 	double currKey = 0;
 
+	if (m_elements.getPackedType() != kDataType_Invalid)
+	{
+		for (UInt32 idx = 0; idx < Size(); idx++, currKey += 1)
+			keysArr->SetElementNumber(currKey, currKey);
+		return keysArr;
+	}
+
 	for (ArrayIterator iter = m_elements.begin(); !iter.End(); ++iter)
 	{
 		if (m_keyType == kDataType_Numeric)
@@ -945,6 +1096,15 @@ ArrayVar* ArrayVar::GetKeys(UInt8 modIndex)
 ArrayVar* ArrayVar::Copy(UInt8 modIndex, bool bDeepCopy)
 {
 	ArrayVar* copyArr = g_ArrayMap.Create(m_keyType, m_bPacked, modIndex);
+	if (DataType packedType = m_elements.getPackedType())
+	{
+		copyArr->PackAs(packedType);
+		if (packedType == kDataType_Numeric)
+			copyArr->m_elements.getNumbersPtr()->Concatenate(*m_elements.getNumbersPtr());
+		else
+			copyArr->m_elements.getFormsPtr()->Concatenate(*m_elements.getFormsPtr());
+		return copyArr;
+	}
 	const ArrayElement* arrElem;
 	for (ArrayIterator iter = m_elements.begin(); !iter.End(); ++iter)
 	{
@@ -985,14 +1145,24 @@ ArrayVar* ArrayVar::MakeSlice(const Slice* slice, UInt8 modIndex)
 	default:
 	case kContainer_Array:
 		{
-			ElementVector* pArray = m_elements.getArrayPtr();
-			UInt32 arrSize = pArray->Size(), iLow = (int)slice->m_lower, iHigh = (int)slice->m_upper;
+			UInt32 arrSize = Size(), iLow = (int)slice->m_lower, iHigh = (int)slice->m_upper;
 			if (iHigh >= arrSize)
 				iHigh = arrSize - 1;
 			if ((iLow >= arrSize) || (iLow > iHigh))
 				break;
-			ArrayElement* elements = pArray->Data();
 			double packedIndex = 0;
+			if (m_elements.getPackedType() != kDataType_Invalid)
+			{
+				ArrayElement packedElem;
+				for (UInt32 idx = iLow; idx <= iHigh; idx++)
+				{
+					GetPackedElement(idx, &packedElem);
+					newVar->SetElement(packedIndex, &packedElem);
+					packedIndex += 1;
+				}
+				break;
+			}
+			ArrayElement* elements = m_elements.getArrayPtr()->Data();
 			for (int idx = iLow; idx <= iHigh; idx++)
 			{
 				newVar->SetElement(packedIndex, &elements[idx]);
@@ -1126,6 +1296,34 @@ void ArrayVar::Sort(ArrayVar* result, SortOrder order, SortType type, Script* co
 
 	if (Empty()) return;
 
+	DataType packedType = m_elements.getPackedType();
+	if ((packedType != kDataType_Invalid) && (type != kSortType_UserFunction) &&
+		((type != kSortType_Alpha) || (packedType != kDataType_Form)) && result->PackAs(packedType))
+	{
+		bool descending = (order == kSort_Descending);
+		if (packedType == kDataType_Numeric)
+		{
+			PackedNumVector* pOutArr = result->m_elements.getNumbersPtr();
+			pOutArr->Concatenate(*m_elements.getNumbersPtr());
+			if (descending)
+				std::sort(pOutArr->Data(), pOutArr->Data() + pOutArr->Size(), std::greater<double>());
+			else
+				std::sort(pOutArr->Data(), pOutArr->Data() + pOutArr->Size());
+		}
+		else
+		{
+			PackedFormVector* pOutArr = result->m_elements.getFormsPtr();
+			pOutArr->Concatenate(*m_elements.getFormsPtr());
+			if (descending)
+				std::sort(pOutArr->Data(), pOutArr->Data() + pOutArr->Size(), std::greater<UInt32>());
+			else
+				std::sort(pOutArr->Data(), pOutArr->Data() + pOutArr->Size());
+		}
+		return;
+	}
+
+	Unpack();
+	result->Unpack();
 	ArrayIterator iter = m_elements.begin();
 	DataType dataType = iter.second()->DataType();
 	if ((dataType == kDataType_Invalid) || (dataType == kDataType_Array)) // nonsensical to sort array of arrays
@@ -1191,6 +1389,7 @@ void ArrayVar::Dump()
 	              owningModName);
 	_MESSAGE("** Dumping Array #%d **\nRefs: %d Owner %02X: %s", m_ID, m_refs.Size(), m_owningModIndex, owningModName);
 
+	Unpack();
 	for (ArrayIterator iter = m_elements.begin(); !iter.End(); ++iter)
 	{
 		char numBuf[0x50];
@@ -1257,6 +1456,19 @@ std::string ArrayVar::GetStringRepresentation() const
 	case kContainer_Array:
 		{
 			std::string result = "[";
+			if (m_elements.getPackedType() != kDataType_Invalid)
+			{
+				ArrayElement packedElem;
+				for (UInt32 idx = 0; idx < Size(); idx++)
+				{
+					GetPackedElement(idx, &packedElem);
+					result += packedElem.GetStringRepresentation();
+					if (idx != Size() - 1)
+						result += ", ";
+				}
+				result += "]";
+				return result;
+			}
 			auto* container = this->m_elements.getArrayPtr();
 			for (auto iter = container->Begin(); !iter.End(); ++iter)
 			{
@@ -1338,7 +1550,6 @@ ArrayVarMap* ArrayVarMap::GetSingleton()
 ArrayVar* ArrayVarMap::Add(UInt32 varID, UInt32 keyType, bool packed, UInt8 modIndex, UInt32 numRefs, UInt8* refs)
 {
 	ArrayVar* var = VarMap::Insert(varID, keyType, packed, modIndex);
-	availableIDs.Erase(varID);
 	var->m_ID = varID;
 	if (numRefs) // record references to this array
 		var->m_refs.Concatenate(refs, numRefs);
@@ -1347,15 +1558,66 @@ ArrayVar* ArrayVarMap::Add(UInt32 varID, UInt32 keyType, bool packed, UInt8 modI
 	return var;
 }
 
+// arrays created by this thread inside the user functions it is running, see BeginYoungScope
+struct YoungArrayLog
+{
+	struct Entry
+	{
+		ArrayID	id;
+		UInt32	serial;
+	};
+
+	std::vector<Entry>	entries;
+	UInt32				depth = 0;
+};
+
+static thread_local YoungArrayLog s_youngArrays;
+static std::atomic<UInt32> s_arraySerial = 0;
+
 ArrayVar* ArrayVarMap::Create(UInt32 keyType, bool bPacked, UInt8 modIndex)
 {
 	ArrayID varID = GetUnusedID();
 	ArrayVar* newVar = VarMap::Insert(varID, keyType, bPacked, modIndex);
 	newVar->m_ID = varID;
+	newVar->m_serial = ++s_arraySerial;
 	MarkTemporary(varID, true); // queue for deletion until a reference to this array is made
+	m_numCreated.fetch_add(1, std::memory_order_relaxed);
+	if (s_youngArrays.depth)
+		s_youngArrays.entries.push_back(YoungArrayLog::Entry{varID, newVar->m_serial});
 	return newVar;
 }
 
+UInt32 ArrayVarMap::BeginYoungScope()
+{
+	s_youngArrays.depth++;
+	return s_youngArrays.entries.size();
+}
+
+void ArrayVarMap::EndYoungScope(UInt32 mark, ArrayID keep)
+{
+	auto& entries = s_youngArrays.entries;
+	// newest first, containers usually are created after what they hold, which becomes temporary when they're
+	// deleted. Arrays released that way after being passed over are left to Collect().
+	for (UInt32 i = entries.size(); i-- > mark; )
+	{
+		auto& entry = entries[i];
+		ArrayVar* var = Get(entry.id);
+		if (!var || var->m_serial != entry.serial)
+			entry.id = 0;
+		else if (entry.id != keep && IsTemporary(entry.id))
+		{
+			Delete(entry.id);
+			entry.id = 0;
+		}
+	}
+
+	// survivors become part of the calling function's generation
+	if (--s_youngArrays.depth)
+		entries.erase(std::remove_if(entries.begin() + mark, entries.end(), [](const YoungArrayLog::Entry& entry) { return !entry.id; }), entries.end());
+	else
+		entries.clear();
+}
+
 void ArrayVarMap::AddReference(ArrayID* ref, ArrayID toRef, UInt8 referringModIndex)
 {
 	if (*ref) // refers to a different array, remove that reference
@@ -1414,9 +1676,22 @@ ArrayElement* ArrayVarMap::GetElement(ArrayID id, const ArrayKey* key)
 	return arr ? arr->Get(key, false) : NULL;
 }
 
+// unreferenced arrays holding other arrays are saved so that those are released once they are collected after loading
+bool ArrayVarMap::HoldsArrays(ArrayVar* var)
+{
+	if (var->m_elements.getPackedType() != kDataType_Invalid)
+		return false;
+	for (ArrayIterator elems = var->m_elements.begin(); !elems.End(); ++elems)
+	{
+		if (elems.second()->m_data.dataType == kDataType_Array)
+			return true;
+	}
+	return false;
+}
+
 void ArrayVarMap::Save(NVSESerializationInterface* intfc)
 {
-	Clean();
+	Collect(kCollectBudget);
 
 	Serialization::OpenRecord('ARVS', kVersion);
 
@@ -1429,12 +1704,10 @@ void ArrayVarMap::Save(NVSESerializationInterface* intfc)
 	UInt16 len;
 	for (auto iter = vars.Begin(); !iter.End(); ++iter)
 	{
-		if (IsTemporary(iter.Key()))
-			continue;
-
 		pVar = &iter.Get();
 		numRefs = pVar->m_refs.Size();
-		if (!numRefs) continue;
+		if (IsTemporary(iter.Key()) ? !HoldsArrays(pVar) : !numRefs)
+			continue;
 		keyType = pVar->m_keyType;
 
 		Serialization::OpenRecord('ARVR', kVersion);
@@ -1449,6 +1722,20 @@ void ArrayVarMap::Save(NVSESerializationInterface* intfc)
 		Serialization::WriteRecord32(numRefs);
 		if (!numRefs) continue;
 
+		// packed arrays have no keys to write, and their elements are all of one type
+		if (DataType packedType = pVar->m_elements.getPackedType())
+		{
+			for (UInt32 idx = 0; idx < numRefs; idx++)
+			{
+				Serialization::WriteRecord8(packedType);
+				if (packedType == kDataType_Numeric)
+					Serialization::WriteRecord64(&(*pVar->m_elements.getNumbersPtr())[idx]);
+				else
+					Serialization::WriteRecord32((*pVar->m_elements.getFormsPtr())[idx]);
+			}
+			continue;
+		}
+
 		for (ArrayIterator elems = pVar->m_elements.begin(); !elems.End(); ++elems)
 		{
 			pKey = elems.first();
@@ -1689,6 +1976,8 @@ void ArrayVarMap::Load(NVSESerializationInterface* intfc)
 						break;
 					}
 				}
+				if (contType == kContainer_Array)
+					newArr->m_elements.pack(elements[0].DataType());
 				break;
 			}
 		default:
@@ -1703,8 +1992,16 @@ void ArrayVarMap::Clean() // garbage collection: delete unreferenced arrays
 	// ArrayVar destructor may queue more IDs for deletion if deleted array contains other arrays
 	// so on each pass through the loop we delete the first ID in the queue until none remain
 
-	while (!tempIDs.Empty())
-		Delete(tempIDs.LastKey());
+	while (ids.HasTemporary())
+		Delete(ids.LastTemporary());
+	m_numCreated = 0;
+}
+
+void ArrayVarMap::Collect(UInt32 budget)
+{
+	budget += m_numCreated.exchange(0, std::memory_order_relaxed);
+	while (budget-- && ids.HasTemporary())
+		Delete(ids.LastTemporary());
 }
 
 void ArrayVarMap::DumpAll()
@@ -1781,7 +2078,7 @@ namespace PluginAPI
 	{
 		ArrayVar* arrVar = g_ArrayMap.Get((ArrayID)arr);
 		if (arrVar && (arrVar->KeyType() == kDataType_Numeric) && arrVar->IsPacked())
-			arrVar->SetElementFromAPI((int)arrVar->m_elements.getArrayPtr()->Size(), &value);
+			arrVar->SetElementFromAPI((int)arrVar->Size(), &value);
 	}
 
 	UInt32 ArrayAPI::GetArraySize(NVSEArrayVarInterface::Array* arr)
@@ -1839,6 +2136,18 @@ namespace PluginAPI
 		{
 			UInt8 keyType = var->KeyType();
 			UInt32 i = 0;
+			if (var->m_elements.getPackedType() != kDataType_Invalid)
+			{
+				ArrayElement packedElem;
+				for (; i < var->Size(); i++)
+				{
+					if (keys)
+						keys[i] = (double)i;
+					var->GetPackedElement(i, &packedElem);
+					InternalElemToPluginElem(&packedElem, &elements[i]);
+				}
+				return true;
+			}
 			for (ArrayIterator iter = var->m_elements.begin(); !iter.End(); ++iter)
 			{
 				if (keys)
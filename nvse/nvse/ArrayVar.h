@@ -13,6 +13,7 @@ struct ScriptToken;
 #include "VarMap.h"
 #include "Serialization.h"
 #include "GameAPI.h"
+#include <atomic>
 #include <map>
 #include <memory>
 #include <vector>
@@ -155,7 +156,82 @@ enum ContainerType
 
 typedef Vector<ArrayElement> ElementVector;
 typedef Map<double, ArrayElement> ElementNumMap;
-typedef Map<char*, ArrayElement> ElementStrMap;
+
+// arrays holding only numbers or only forms are stored as plain doubles or form IDs, see ArrayVarElementContainer::pack()
+typedef Vector<double> PackedNumVector;
+typedef Vector<UInt32> PackedFormVector;
+
+// String keyed elements, hashed case insensitively with StrHashCI so that lookups, inserts and erases are O(1).
+// Iteration is in key order as with Map; the order is sorted on the first iteration and then kept up to date by
+// inserts and erases, until the entries grow.
+// Elements are allocated one by one so that pointers to them stay valid while the map grows.
+class ElementStrMap
+{
+	struct Entry
+	{
+		char			*key;
+		UInt32			hash;
+		ArrayElement	*value;
+	};
+
+	Entry		*entries;		// 00 in insertion order, erasing moves the last entry into the gap
+	UInt32		numEntries;		// 04
+	UInt32		numAlloc;		// 08
+	UInt32		*buckets;		// 0C 1 + index of an entry, 0 if free; linear probing
+	UInt32		numBuckets;		// 10 power of 2
+	UInt32		*order;			// 14 numAlloc indices of the entries in key order, then numAlloc positions of each entry in it; null if not built
+
+	UInt32 FindEntry(const char *key, UInt32 hash, UInt32 *outBucket) const;	// index of the entry or -1, outBucket gets its bucket or the free one to use
+	void Rehash(UInt32 newCount);
+	void RemoveEntry(UInt32 index, UInt32 bucket);
+	void InvalidateOrder();
+	const UInt32* Order();
+	void InsertIntoOrder(UInt32 index);		// index is the entry just appended
+	void RemoveFromOrder(UInt32 index);		// before the entry is removed
+
+public:
+	ElementStrMap() : entries(nullptr), numEntries(0), numAlloc(2), buckets(nullptr), numBuckets(0), order(nullptr) {}
+	~ElementStrMap();
+
+	UInt32 Size() const {return numEntries;}
+	bool Empty() const {return !numEntries;}
+
+	ArrayElement* Emplace(const char *key);		// inserts a default element if the key isn't there yet
+	ArrayElement& operator[](const char *key) {return *Emplace(key);}
+	ArrayElement* GetPtr(const char *key) const;
+	bool Erase(const char *key);
+	void Clear();
+
+	ArrayElement& ValueAt(UInt32 index) const {return *entries[index].value;}	// in no particular order
+
+	// same layout as ArrayVarElementContainer::iterator::GenericIterator
+	class Iterator
+	{
+		ElementStrMap	*table;
+		void			*unused;
+		UInt32			index;
+
+	public:
+		Iterator() : table(nullptr), unused(nullptr), index(0) {}
+		Iterator(ElementStrMap &source) : table(&source), unused(nullptr), index(0) {}
+
+		void Init(ElementStrMap &source) {table = &source; index = 0;}
+		void Last(ElementStrMap &source) {table = &source; index = source.numEntries - 1;}
+		void Find(ElementStrMap &source, const char *key);
+
+		bool End() const {return index >= table->numEntries;}
+		void operator++() {index++;}
+		void operator--() {index--;}
+		UInt32 Index() const {return index;}
+
+		const char* Key() const {return table->entries[table->Order()[index]].key;}
+		ArrayElement& Get() const {return *table->entries[table->Order()[index]].value;}
+		void Remove(bool frwrd = true);
+	};
+
+	Iterator Begin() {return Iterator(*this);}
+	Iterator Find(const char *key) {Iterator iter; iter.Find(*this, key); return iter;}
+};
 
 class ArrayVarElementContainer
 {
@@ -166,21 +242,29 @@ class ArrayVarElementContainer
 		void *data;
 		UInt32		 numItems;
 		UInt32		 numAlloc;
+		UInt32		 mapData[3];	// rest of ElementStrMap
 	};
+	static_assert(sizeof(ElementStrMap) <= sizeof(GenericContainer));
 
 	ContainerType		m_type;
+	DataType			m_packedType;	// kDataType_Numeric or kDataType_Form while a kContainer_Array is stored packed
 	GenericContainer	m_container;
 
 	ElementVector& AsArray() const {return *(ElementVector*)&m_container;}
 	ElementNumMap& AsNumMap() const {return *(ElementNumMap*)&m_container;}
 	ElementStrMap& AsStrMap() const {return *(ElementStrMap*)&m_container;}
+	PackedNumVector& AsNumbers() const {return *(PackedNumVector*)&m_container;}
+	PackedFormVector& AsForms() const {return *(PackedFormVector*)&m_container;}
+
+	void UnpackElements(ArrayID owner);
 
 public:
-	ArrayVarElementContainer() : m_type(kContainer_Array)
+	ArrayVarElementContainer() : m_type(kContainer_Array), m_packedType(kDataType_Invalid)
 	{
 		m_container.data = NULL;
 		m_container.numItems = 0;
 		m_container.numAlloc = 2;
+		m_container.mapData[0] = m_container.mapData[1] = m_container.mapData[2] = 0;
 	}
 
 	~ArrayVarElementContainer();
@@ -195,6 +279,16 @@ public:
 
 	UInt32 erase(UInt32 iLow, UInt32 iHigh);
 
+	// Switches an array whose elements all have the given type, numbers or forms, to packed storage. Empty arrays
+	// can always be packed. Returns false, leaving the array as it is, if it has other elements.
+	bool pack(DataType type);
+
+	// Converts a packed array back to ArrayElements owned by owner. Must be done before pointers to elements
+	// are handed out or iterators are created, which only work on unpacked arrays.
+	void unpack(ArrayID owner) {if (m_packedType != kDataType_Invalid) UnpackElements(owner);}
+
+	DataType getPackedType() const {return m_packedType;}
+
 	class iterator
 	{
 		friend ArrayVarElementContainer;
@@ -205,6 +299,7 @@ public:
 			void				*pData;
 			UInt32				index;
 		};
+		static_assert(sizeof(ElementStrMap::Iterator) <= sizeof(GenericIterator));
 
 		ContainerType	m_type;
 		GenericIterator	m_iter;
@@ -236,6 +331,8 @@ public:
 	ElementVector* getArrayPtr() const {return &AsArray();}
 	ElementNumMap* getNumMapPtr() const {return &AsNumMap();}
 	ElementStrMap* getStrMapPtr() const {return &AsStrMap();}
+	PackedNumVector* getNumbersPtr() const {return &AsNumbers();}
+	PackedFormVector* getFormsPtr() const {return &AsForms();}
 };
 
 typedef ArrayVarElementContainer::iterator ArrayIterator;
@@ -254,6 +351,13 @@ class ArrayVar
 	UInt8				m_keyType;
 	bool				m_bPacked;
 	Vector<UInt8>		m_refs;		// data is modIndex of referring object; size() is number of references
+	UInt32				m_serial;	// set by ArrayVarMap::Create, tells a reused ID apart in the young generation log
+
+	void Unpack() {m_elements.unpack(m_ID);}
+	bool PackAs(DataType type);
+	UInt32 PackedIndex(double key) const;	// -1 if out of range
+	void GetPackedElement(UInt32 index, ArrayElement* out) const;
+	bool GetPackedElement(UInt32 index, ArrayElement** outElem, const ArrayKey** outKey);
 
 public:
 	ArrayVar(UInt32 keyType, bool packed, UInt8 modIndex);
@@ -279,6 +383,8 @@ public:
 	bool Empty() const {return m_elements.empty();}
 	ContainerType GetContainerType() const {return m_elements.m_type;}
 
+	// Pointers to elements may be written through, so a packed array is unpacked first. Reads should use the
+	// typed GetElement* accessors, and iteration GetFirstElement() and co, which don't.
 	ArrayElement* Get(const ArrayKey* key, bool bCanCreateNew);
 	ArrayElement* Get(double key, bool bCanCreateNew);
 	ArrayElement* Get(const char* key, bool bCanCreateNew);
@@ -289,6 +395,7 @@ public:
 
 	bool SetElementNumber(double key, double num);
 	bool SetElementNumber(const char* key, double num);
+	bool SetElementNumber(const ArrayKey* key, double num);
 
 	bool SetElementString(double key, const char* str);
 	bool SetElementString(const char* key, const char* str);
@@ -315,6 +422,7 @@ public:
 
 	const ArrayKey* Find(const ArrayElement* toFind, const Slice* range = NULL);
 
+	// for packed arrays outElem gets a per thread copy of the element, valid until the next call
 	bool GetFirstElement(ArrayElement** outElem, const ArrayKey** outKey);
 	bool GetLastElement(ArrayElement** outElem, const ArrayKey** outKey);
 	bool GetNextElement(const ArrayKey* prevKey, ArrayElement** outElem, const ArrayKey** outKey);
@@ -345,10 +453,26 @@ class ArrayVarMap : public VarMap<ArrayVar>
 	static const UInt32 kVersion = 2;
 
 	ArrayVar* Add(UInt32 varID, UInt32 keyType, bool packed, UInt8 modIndex, UInt32 numRefs, UInt8* refs);
+
+	std::atomic<UInt32>	m_numCreated = 0;	// since the last Collect()
+
+	static bool HoldsArrays(ArrayVar* var);
+
 public:
+	// Unreferenced arrays are collected in two generations. Arrays created while a user function runs are
+	// young: they are logged per thread and those still unreferenced when the function returns, other than
+	// its result, are deleted right away. All other temporaries are old and reclaimed by Collect(), a bounded
+	// number per call; each array created since the last call adds one to the budget, so only cascades from
+	// deleting nested arrays are spread over several frames.
+	static constexpr UInt32 kCollectBudget = 256;
+
 	void Save(NVSESerializationInterface* intfc);
 	void Load(NVSESerializationInterface* intfc);
-	void Clean();
+	void Clean();	// deletes all temporaries
+	void Collect(UInt32 budget);
+
+	UInt32 BeginYoungScope();	// returns the mark to pass to EndYoungScope
+	void EndYoungScope(UInt32 mark, ArrayID keep);
 
 	ArrayVar* Create(UInt32 keyType, bool bPacked, UInt8 modIndex);
 	ArrayVar* CreateArray(UInt8 modIndex) { return Create(kDataType_Numeric, true, modIndex); }
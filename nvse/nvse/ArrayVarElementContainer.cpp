@@ -1,14 +1,242 @@
 #include "ArrayVar.h"
+#include <algorithm>
 
 #if RUNTIME
 
+ElementStrMap::~ElementStrMap()
+{
+	InvalidateOrder();
+	if (!entries) return;
+	Clear();
+	POOL_FREE(entries, numAlloc, Entry);
+	entries = nullptr;
+	if (buckets)
+	{
+		POOL_FREE(buckets, numBuckets, UInt32);
+		buckets = nullptr;
+		numBuckets = 0;
+	}
+}
+
+UInt32 ElementStrMap::FindEntry(const char *key, UInt32 hash, UInt32 *outBucket) const
+{
+	if (!numBuckets) return -1;
+	UInt32 mask = numBuckets - 1, bucket = hash & mask;
+	while (UInt32 slot = buckets[bucket])
+	{
+		Entry &entry = entries[slot - 1];
+		if ((entry.hash == hash) && !StrCompare(entry.key, key))
+		{
+			if (outBucket) *outBucket = bucket;
+			return slot - 1;
+		}
+		bucket = (bucket + 1) & mask;
+	}
+	if (outBucket) *outBucket = bucket;
+	return -1;
+}
+
+void ElementStrMap::Rehash(UInt32 newCount)
+{
+	if (buckets) POOL_FREE(buckets, numBuckets, UInt32);
+	numBuckets = newCount;
+	buckets = (UInt32*)Pool_Alloc_Buckets(newCount);
+	UInt32 mask = newCount - 1;
+	for (UInt32 index = 0; index < numEntries; index++)
+	{
+		UInt32 bucket = entries[index].hash & mask;
+		while (buckets[bucket])
+			bucket = (bucket + 1) & mask;
+		buckets[bucket] = index + 1;
+	}
+}
+
+void ElementStrMap::InvalidateOrder()
+{
+	if (!order) return;
+	POOL_FREE(order, numAlloc * 2, UInt32);
+	order = nullptr;
+}
+
+const UInt32* ElementStrMap::Order()
+{
+	if (order) return order;
+	order = POOL_ALLOC(numAlloc * 2, UInt32);
+	for (UInt32 index = 0; index < numEntries; index++)
+		order[index] = index;
+	std::sort(order, order + numEntries, [this](UInt32 lhs, UInt32 rhs)
+	{
+		return StrCompare(entries[lhs].key, entries[rhs].key) < 0;
+	});
+	UInt32 *ranks = order + numAlloc;
+	for (UInt32 rank = 0; rank < numEntries; rank++)
+		ranks[order[rank]] = rank;
+	return order;
+}
+
+void ElementStrMap::InsertIntoOrder(UInt32 index)
+{
+	UInt32 *ranks = order + numAlloc, count = numEntries - 1, lBound = 0, uBound = count;
+	const char *key = entries[index].key;
+	while (lBound != uBound)
+	{
+		UInt32 middle = (lBound + uBound) >> 1;
+		if (StrCompare(entries[order[middle]].key, key) < 0)
+			lBound = middle + 1;
+		else
+			uBound = middle;
+	}
+	memmove(order + lBound + 1, order + lBound, (count - lBound) * sizeof(UInt32));
+	order[lBound] = index;
+	for (UInt32 rank = lBound; rank <= count; rank++)
+		ranks[order[rank]] = rank;
+}
+
+void ElementStrMap::RemoveFromOrder(UInt32 index)
+{
+	UInt32 *ranks = order + numAlloc, last = numEntries - 1, removed = ranks[index];
+	memmove(order + removed, order + removed + 1, (last - removed) * sizeof(UInt32));
+	for (UInt32 rank = removed; rank < last; rank++)
+		ranks[order[rank]] = rank;
+	// the last entry is about to be moved into the gap
+	if (index != last)
+	{
+		order[ranks[last]] = index;
+		ranks[index] = ranks[last];
+	}
+}
+
+ArrayElement* ElementStrMap::Emplace(const char *key)
+{
+	UInt32 hash = StrHashCI(key), bucket;
+	UInt32 index = FindEntry(key, hash, &bucket);
+	if (index != -1)
+		return entries[index].value;
+	if (((numEntries + 1) << 1) > numBuckets)
+	{
+		Rehash(numBuckets ? (numBuckets << 1) : 8);
+		FindEntry(key, hash, &bucket);
+	}
+	// the order is sized by numAlloc, so it is only rebuilt after the entries grew
+	if (!entries)
+	{
+		InvalidateOrder();
+		numAlloc = AlignNumAlloc<Entry>(numAlloc);
+		entries = POOL_ALLOC(numAlloc, Entry);
+	}
+	else if (numAlloc <= numEntries)
+	{
+		InvalidateOrder();
+		UInt32 newAlloc = numAlloc << 1;
+		POOL_REALLOC(entries, numAlloc, newAlloc, Entry);
+		numAlloc = newAlloc;
+	}
+	Entry &entry = entries[numEntries];
+	entry.key = CopyString(key);
+	entry.hash = hash;
+	entry.value = new (ALLOC_NODE(ArrayElement)) ArrayElement();
+	buckets[bucket] = ++numEntries;
+	if (order)
+		InsertIntoOrder(numEntries - 1);
+	return entry.value;
+}
+
+ArrayElement* ElementStrMap::GetPtr(const char *key) const
+{
+	UInt32 index = FindEntry(key, StrHashCI(key), nullptr);
+	return (index != -1) ? entries[index].value : nullptr;
+}
+
+void ElementStrMap::RemoveEntry(UInt32 index, UInt32 bucket)
+{
+	if (order)
+		RemoveFromOrder(index);
+	Entry &entry = entries[index];
+	free(entry.key);
+	entry.value->~ArrayElement();
+	Pool_Free(entry.value, sizeof(ArrayElement));
+
+	// backward shift deletion keeps the probe sequences of the following entries unbroken
+	UInt32 mask = numBuckets - 1, next = bucket;
+	while (true)
+	{
+		next = (next + 1) & mask;
+		UInt32 slot = buckets[next];
+		if (!slot) break;
+		UInt32 home = entries[slot - 1].hash & mask;
+		if (((next - home) & mask) >= ((next - bucket) & mask))
+		{
+			buckets[bucket] = slot;
+			bucket = next;
+		}
+	}
+	buckets[bucket] = 0;
+
+	// fill the gap with the last entry
+	if (index != --numEntries)
+	{
+		entry = entries[numEntries];
+		UInt32 moved = entry.hash & mask;
+		while (buckets[moved] != numEntries + 1)
+			moved = (moved + 1) & mask;
+		buckets[moved] = index + 1;
+	}
+}
+
+bool ElementStrMap::Erase(const char *key)
+{
+	UInt32 bucket;
+	UInt32 index = FindEntry(key, StrHashCI(key), &bucket);
+	if (index == -1) return false;
+	RemoveEntry(index, bucket);
+	return true;
+}
+
+void ElementStrMap::Clear()
+{
+	if (!numEntries) return;
+	InvalidateOrder();
+	for (UInt32 index = 0; index < numEntries; index++)
+	{
+		Entry &entry = entries[index];
+		free(entry.key);
+		entry.value->~ArrayElement();
+		Pool_Free(entry.value, sizeof(ArrayElement));
+	}
+	numEntries = 0;
+	MemZero(buckets, numBuckets * sizeof(UInt32));
+}
+
+void ElementStrMap::Iterator::Find(ElementStrMap &source, const char *key)
+{
+	table = &source;
+	UInt32 found = source.FindEntry(key, StrHashCI(key), nullptr);
+	index = (found != -1) ? source.Order()[source.numAlloc + found] : -1;
+}
+
+void ElementStrMap::Iterator::Remove(bool frwrd)
+{
+	UInt32 entryIdx = table->Order()[index];
+	Entry &entry = table->entries[entryIdx];
+	UInt32 bucket = entry.hash & (table->numBuckets - 1);
+	while (table->buckets[bucket] != entryIdx + 1)
+		bucket = (bucket + 1) & (table->numBuckets - 1);
+	table->RemoveEntry(entryIdx, bucket);
+	if (frwrd) index--;
+}
+
 ArrayVarElementContainer::~ArrayVarElementContainer()
 {
 	clear();
 	switch (m_type)
 	{
 		case kContainer_Array:
-			AsArray().~ElementVector();
+			if (m_packedType == kDataType_Numeric)
+				AsNumbers().~PackedNumVector();
+			else if (m_packedType == kDataType_Form)
+				AsForms().~PackedFormVector();
+			else
+				AsArray().~ElementVector();
 			break;
 		case kContainer_NumericMap:
 			AsNumMap().~ElementNumMap();
@@ -27,8 +255,11 @@ void ArrayVarElementContainer::clear()
 		default:
 		case kContainer_Array:
 		{
-			for (auto iter = AsArray().Begin(); !iter.End(); ++iter)
-				iter.Get().Unset();
+			if (m_packedType == kDataType_Invalid)
+			{
+				for (auto iter = AsArray().Begin(); !iter.End(); ++iter)
+					iter.Get().Unset();
+			}
 			m_container.numItems = 0;
 			break;
 		}
@@ -41,8 +272,8 @@ void ArrayVarElementContainer::clear()
 		}
 		case kContainer_StringMap:
 		{
-			for (auto iter = AsStrMap().Begin(); !iter.End(); ++iter)
-				iter.Get().Unset();
+			for (UInt32 index = 0; index < AsStrMap().Size(); index++)
+				AsStrMap().ValueAt(index).Unset();
 			AsStrMap().Clear();
 			break;
 		}
@@ -62,8 +293,15 @@ UInt32 ArrayVarElementContainer::erase(const ArrayKey *key)
 			UInt32 idx = (int)key->key.num;
 			if (idx >= m_container.numItems)
 				return 0;
-			AsArray()[idx].Unset();
-			AsArray().RemoveNth(idx);
+			if (m_packedType == kDataType_Numeric)
+				AsNumbers().RemoveNth(idx);
+			else if (m_packedType == kDataType_Form)
+				AsForms().RemoveNth(idx);
+			else
+			{
+				AsArray()[idx].Unset();
+				AsArray().RemoveNth(idx);
+			}
 			return 1;
 		}
 		case kContainer_NumericMap:
@@ -81,11 +319,11 @@ UInt32 ArrayVarElementContainer::erase(const ArrayKey *key)
 		{
 			if (key->key.dataType != kDataType_String)
 				return 0;
-			auto findKey = AsStrMap().Find(key->key.str);
-			if (findKey.End())
+			ArrayElement *elem = AsStrMap().GetPtr(key->key.str);
+			if (!elem)
 				return 0;
-			findKey.Get().Unset();
-			findKey.Remove(false);
+			elem->Unset();
+			AsStrMap().Erase(key->key.str);
 			return 1;
 		}
 	}
@@ -103,6 +341,16 @@ UInt32 ArrayVarElementContainer::erase(UInt32 iLow, UInt32 iHigh)
 	iHigh++;
 	if (m_type == kContainer_Array)
 	{
+		if (m_packedType == kDataType_Numeric)
+		{
+			AsNumbers().RemoveRange(iLow, iHigh - iLow);
+			return iHigh - iLow;
+		}
+		if (m_packedType == kDataType_Form)
+		{
+			AsForms().RemoveRange(iLow, iHigh - iLow);
+			return iHigh - iLow;
+		}
 		ArrayElement* elements = AsArray().Data();
 		for (UInt32 idx = iLow; idx < iHigh; idx++)
 			elements[idx].Unset();
@@ -129,6 +377,72 @@ UInt32 ArrayVarElementContainer::erase(UInt32 iLow, UInt32 iHigh)
 	return -1;
 }
 
+bool ArrayVarElementContainer::pack(DataType type)
+{
+	if ((m_type != kContainer_Array) || ((type != kDataType_Numeric) && (type != kDataType_Form)))
+		return false;
+	if (m_packedType != kDataType_Invalid)
+		return m_packedType == type;
+	ElementVector &elements = AsArray();
+	UInt32 numElems = elements.Size();
+	for (UInt32 idx = 0; idx < numElems; idx++)
+		if (elements[idx].DataType() != type)
+			return false;
+
+	GenericContainer generic = m_container;
+	m_container.data = NULL;
+	m_container.numItems = 0;
+	m_container.numAlloc = 2;
+	m_packedType = type;
+
+	ElementVector &source = *(ElementVector*)&generic;
+	if (type == kDataType_Numeric)
+	{
+		for (UInt32 idx = 0; idx < numElems; idx++)
+			AsNumbers().Append(source[idx].m_data.num);
+	}
+	else
+	{
+		for (UInt32 idx = 0; idx < numElems; idx++)
+			AsForms().Append(source[idx].m_data.formID);
+	}
+	source.~ElementVector();
+	return true;
+}
+
+void ArrayVarElementContainer::UnpackElements(ArrayID owner)
+{
+	GenericContainer packed = m_container;
+	m_container.data = NULL;
+	m_container.numItems = 0;
+	m_container.numAlloc = 2;
+
+	ElementVector &elements = AsArray();
+	if (m_packedType == kDataType_Numeric)
+	{
+		PackedNumVector &numbers = *(PackedNumVector*)&packed;
+		for (UInt32 idx = 0; idx < numbers.Size(); idx++)
+		{
+			ArrayElement *elem = elements.Append();
+			elem->m_data.owningArray = owner;
+			elem->SetNumber(numbers[idx]);
+		}
+		numbers.~PackedNumVector();
+	}
+	else
+	{
+		PackedFormVector &forms = *(PackedFormVector*)&packed;
+		for (UInt32 idx = 0; idx < forms.Size(); idx++)
+		{
+			ArrayElement *elem = elements.Append();
+			elem->m_data.owningArray = owner;
+			elem->SetFormID(forms[idx]);
+		}
+		forms.~PackedFormVector();
+	}
+	m_packedType = kDataType_Invalid;
+}
+
 ArrayVarElementContainer::iterator::iterator(ArrayVarElementContainer& container)
 {
 	m_type = container.m_type;
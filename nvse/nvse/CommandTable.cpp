@@ -1606,6 +1606,10 @@ void CommandTable::AddCommandsV5()
 
 	ADD_CMD(SetWeaponAnimationPath);
 	ADD_CMD(SetActorAnimationPath);
+
+	ADD_CMD(ProfileScripts);
+	ADD_CMD(PrintVarCacheStats);
+	ADD_CMD(BenchmarkExpressions);
 }
 
 namespace PluginAPI
@@ -1,8 +1,14 @@
 #include "Commands_Console.h"
+#include "ArrayVar.h"
+#include "FunctionScripts.h"
 #include "GameAPI.h"
 #include "GameForms.h"
+#include "GameRTTI.h"
 #include "GameScript.h"
+#include "ScriptProfiler.h"
+#include "ScriptUtils.h"
 #include "StringVar.h"
+#include "Utilities.h"
 
 bool Cmd_PrintToConsole_Execute(COMMAND_ARGS)
 {
@@ -138,3 +144,109 @@ bool Cmd_GetConsoleOutputFilename_Execute(COMMAND_ARGS)
 	return true;
 }
 
+bool Cmd_ProfileScripts_Execute(COMMAND_ARGS)
+{
+	*result = 0;
+	UInt32 action = 0;
+	UInt32 numEntries = 20;
+
+	if (!ExtractArgs(EXTRACT_ARGS, &action, &numEntries))
+		return true;
+
+	switch (action)
+	{
+	case 0:
+		ScriptProfiler::Stop();
+		Console_Print("Script profiler stopped");
+		break;
+	case 1:
+	case 2:
+		ScriptProfiler::Start(action == 2);
+		Console_Print("Script profiler started%s", action == 2 ? " with tracing" : "");
+		break;
+	case 3:
+		ScriptProfiler::PrintReport(numEntries);
+		break;
+	case 4:
+	{
+		const auto path = GetFalloutDirectory() + "ScriptProfile.json";
+		const auto numEvents = ScriptProfiler::WriteTrace(path.c_str());
+		if (numEvents < 0)
+			Console_Print("Could not write %s", path.c_str());
+		else
+			Console_Print("Wrote %d events to %s", numEvents, path.c_str());
+		break;
+	}
+	default:
+		return true;
+	}
+
+	*result = ScriptProfiler::IsRunning();
+	return true;
+}
+
+template <class Var>
+static void PrintVarCacheStats(const char* name, VarMap<Var>& map, bool reset)
+{
+	UInt32 hits, misses, drops;
+	map.GetCacheStats(hits, misses, drops);
+	const UInt32 lookups = hits + misses;
+	Console_Print("%s: %d lookups, %.1f%% hits, %d cache drops", name, lookups, lookups ? 100.0 * hits / lookups : 0.0, drops);
+	if (reset)
+		map.ResetCacheStats();
+}
+
+bool Cmd_PrintVarCacheStats_Execute(COMMAND_ARGS)
+{
+	*result = 0;
+	UInt32 reset = 0;
+
+	if (!ExtractArgs(EXTRACT_ARGS, &reset))
+		return true;
+
+	PrintVarCacheStats("Arrays", g_ArrayMap, reset != 0);
+	PrintVarCacheStats("Strings", g_StringMap, reset != 0);
+	return true;
+}
+
+// microseconds per call of fnScript, with the given token cache shortcuts on this thread
+static double TimeFunctionCalls(Script* fnScript, UInt32 numCalls, UInt32 fastPaths)
+{
+	const UInt32 savedFastPaths = ExpressionEvaluator::s_fastPaths;
+	ExpressionEvaluator::s_fastPaths = fastPaths;
+	LARGE_INTEGER frequency, start, stop;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+	for (UInt32 i = 0; i < numCalls; ++i)
+	{
+		InternalFunctionCaller caller(fnScript);
+		delete UserFunctionManager::Call(caller);
+	}
+	QueryPerformanceCounter(&stop);
+	ExpressionEvaluator::s_fastPaths = savedFastPaths;
+	return (stop.QuadPart - start.QuadPart) * 1000000.0 / frequency.QuadPart / numCalls;
+}
+
+bool Cmd_BenchmarkExpressions_Execute(COMMAND_ARGS)
+{
+	*result = 0;
+	TESForm* form = NULL;
+	UInt32 numCalls = 10000;
+
+	if (!ExtractArgs(EXTRACT_ARGS, &form, &numCalls))
+		return true;
+
+	Script* fnScript = DYNAMIC_CAST(form, TESForm, Script);
+	if (!fnScript || !numCalls)
+		return true;
+
+	// warm up so that both runs find the expressions parsed and cached
+	TimeFunctionCalls(fnScript, 1, ExpressionEvaluator::kFastPath_All);
+	const double fast = TimeFunctionCalls(fnScript, numCalls, ExpressionEvaluator::kFastPath_All);
+	const double tokens = TimeFunctionCalls(fnScript, numCalls, ExpressionEvaluator::kFastPath_RegisterCode);
+	const double rpn = TimeFunctionCalls(fnScript, numCalls, 0);
+	Console_Print("%d calls: %.3f us/call with all shortcuts, %.3f us/call with conditions evaluated to tokens (%.2fx), %.3f us/call on the RPN interpreter (%.2fx)",
+		numCalls, fast, tokens, fast > 0 ? tokens / fast : 0.0, rpn, fast > 0 ? rpn / fast : 0.0);
+	*result = fast;
+	return true;
+}
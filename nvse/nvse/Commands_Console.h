@@ -14,3 +14,7 @@ DEFINE_CMD_ALT(GetConsoleEcho, , returns whether the engine echoes to the consol
 
 DEFINE_CMD_ALT(HasConsoleOutputFilename, HasCOF, "return if there is a Console Output Filename active", 0, 0, NULL);
 DEFINE_CMD_ALT(GetConsoleOutputFilename, GetCOF, "returns the name of the Console Output Filename", 0, 0, NULL);
+
+DEFINE_CMD_ALT(ProfileScripts, sprof, "profiles script execution. 0: stop, 1: start, 2: start and record a trace, 3: print the N slowest entries, 4: write the trace to ScriptProfile.json", 0, 2, kParams_OneInt_OneOptionalInt);
+DEFINE_CMD_ALT(BenchmarkExpressions, bexpr, "calls a user defined function N times with all token cache shortcuts, without the if eval condition shortcuts and without any and prints the time per call of each", 0, 2, kParams_OneForm_OneOptionalInt);
+DEFINE_CMD_ALT(PrintVarCacheStats, vcstats, "prints the hit rates of the array and string variable lookup caches, resetting the counters if passed 1", 0, 1, kParams_OneOptionalInt);
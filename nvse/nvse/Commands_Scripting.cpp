@@ -112,8 +112,9 @@ bool Cmd_eval_Execute(COMMAND_ARGS)
 	*result = 0;
 	ExpressionEvaluator eval(PASS_COMMAND_ARGS);
 
-	if (eval.ExtractArgs() && eval.Arg(0))
-		*result = eval.Arg(0)->GetBool() ? 1 : 0;
+	bool condition;
+	if (eval.ExtractCondition(condition))
+		*result = condition ? 1 : 0;
 
 	return true;
 }
@@ -1,6 +1,7 @@
 #include "Serialization.h"
 #include "Core_Serialization.h"
 #include "GameData.h"
+#include "ScriptTokenCache.h"
 #include "Hooks_CreatedObject.h"
 #include <string>
 #include "StringVar.h"
@@ -96,6 +97,7 @@ void Core_NewGameCallback(void * reserved)
 
 	g_ArrayMap.Clean();
 	g_StringMap.Clean();
+	VarCache::Invalidate();
 }
 
 void Core_PreLoadCallback(void * reserved)
@@ -8,6 +8,7 @@
 #include "SafeWrite.h"
 #include "FunctionScripts.h"
 #include "GameObjects.h"
+#include "ScriptProfiler.h"
 #include "ThreadLocal.h"
 #include "common/ICriticalSection.h"
 #include "Hooks_Gameplay.h"
@@ -480,19 +481,27 @@ struct DeferredCallback
 	void				*arg0;
 	void				*arg1;
 	EventInfo			*eventInfo;
+	ArrayID				argsArray;	// referenced until the handler ran, as the user function that dispatched the event deletes the arrays it created when it returns
 
-	DeferredCallback(EventCallback *pCallback, void *_arg0, void *_arg1, EventInfo *_eventInfo) : callback(pCallback), arg0(_arg0), arg1(_arg1), eventInfo(_eventInfo) {}
+	DeferredCallback(EventCallback *pCallback, void *_arg0, void *_arg1, EventInfo *_eventInfo) : callback(pCallback), arg0(_arg0), arg1(_arg1), eventInfo(_eventInfo), argsArray(0)
+	{
+		if (arg0 && eventInfo->numParams && (eventInfo->paramTypes[0] == Script::eVarType_Array))
+			g_ArrayMap.AddReference(&argsArray, (ArrayID)arg0, GetArrayOwningModIndex((ArrayID)arg0));
+	}
 
 	~DeferredCallback()
 	{
-		if (callback->removed) return;
-
-		s_eventStack.Push(eventInfo->evName);
-		ScriptToken *result = UserFunctionManager::Call(EventHandlerCaller(callback->script, eventInfo, arg0, arg1));
-		s_eventStack.Pop();
+		if (!callback->removed)
+		{
+			s_eventStack.Push(eventInfo->evName);
+			ScriptToken *result = UserFunctionManager::Call(EventHandlerCaller(callback->script, eventInfo, arg0, arg1));
+			s_eventStack.Pop();
 
-		// result is unused
-		if (result) delete result;
+			// result is unused
+			if (result) delete result;
+		}
+		if (argsArray)
+			g_ArrayMap.RemoveReference(&argsArray, GetArrayOwningModIndex(argsArray));
 	}
 };
 
@@ -528,6 +537,8 @@ void __stdcall HandleEvent(UInt32 id, void* arg0, void* arg1)
 	EventInfo* eventInfo = &s_eventInfos[id];
 	if (eventInfo->callbacks.Empty()) return;
 
+	ScriptProfiler::Scope profilerScope(ScriptProfiler::Kind::Event, nullptr, 0, id, eventInfo->evName);
+
 	for (auto iter = eventInfo->callbacks.Begin(); !iter.End(); ++iter)
 	{
 		EventCallback &callback = iter.Get();
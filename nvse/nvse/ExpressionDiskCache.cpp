@@ -0,0 +1,424 @@
+#include "ExpressionDiskCache.h"
+
+#if RUNTIME
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "GameScript.h"
+#include "ScriptTokenCache.h"
+#include "ScriptUtils.h"
+#include "Utilities.h"
+#include "common/ICriticalSection.h"
+#include "nvse_version.h"
+
+namespace ExpressionDiskCache
+{
+	// File layout: Header, Expression[numExpressions] sorted by formID and offset, Token[numTokens], then the
+	// string pool. Offsets are relative to the start of their section.
+	struct Header
+	{
+		static constexpr UInt32 kMagic = 'CXEN';
+		static constexpr UInt32 kFormatVersion = 1;
+
+		UInt32	magic;
+		UInt32	formatVersion;
+		UInt32	nvseVersion;		// operator rule indices are only valid for the build that wrote them
+		UInt32	numExpressions;
+		UInt32	numTokens;
+		UInt32	stringsSize;
+		UInt64	checksum;			// of everything after the header
+	};
+
+	struct Expression
+	{
+		UInt32	formID;
+		UInt32	offset;			// of the expression in the script data
+		UInt32	length;			// of the expression bytecode, CachedTokens::incrementData
+		UInt32	firstToken;
+		UInt64	hash;			// of the expression bytecode
+		UInt32	numTokens;
+		UInt32	pad;
+
+		UInt64 Key() const { return static_cast<UInt64>(formID) << 32 | offset; }
+	};
+
+	struct Token
+	{
+		static constexpr UInt8 kNoRule = 0xFF;
+
+		double	num;					// numbers and booleans
+		UInt32	data;					// strings: offset in the pool, commands: offset of their arguments from the expression
+		UInt32	length;					// strings
+		UInt16	refIdx;
+		UInt16	id;						// variables: index, commands: opcode, operators: OperatorType
+		UInt8	type;					// Token_Type
+		UInt8	variableType;
+		UInt8	rule;					// index of the operator rule bound when parsing, see TokenCacheEntry::eval
+		UInt8	swapOrder;
+		UInt8	shortCircuitParentType;
+		UInt8	shortCircuitDistance;
+		UInt8	shortCircuitStackOffset;
+		UInt8	pad;
+	};
+
+	static_assert(sizeof(Header) == 0x20 && sizeof(Expression) == 0x20 && sizeof(Token) == 0x20);
+
+	struct Recorded
+	{
+		Expression			expression;
+		std::vector<Token>	tokens;
+		std::string			strings;
+	};
+
+	static ICriticalSection s_lock;
+	static HANDLE s_file = INVALID_HANDLE_VALUE;
+	static HANDLE s_mapping = nullptr;
+	static const UInt8* s_view = nullptr;
+	static const Header* s_header = nullptr;
+	static const Expression* s_expressions = nullptr;
+	static const Token* s_tokens = nullptr;
+	static const char* s_strings = nullptr;
+	static std::map<UInt64, Recorded> s_recorded;
+	static std::vector<bool> s_validated;		// per mapped expression, restored this session
+	static UInt32 s_numValidated = 0;
+
+	static std::string GetPath()
+	{
+		return GetFalloutDirectory() + "NVSEExpressionCache.bin";
+	}
+
+	// FNV-1a
+	static UInt64 Hash(const void* data, UInt32 size, UInt64 hash = 0xCBF29CE484222325)
+	{
+		const auto* bytes = static_cast<const UInt8*>(data);
+		for (UInt32 i = 0; i < size; i++)
+			hash = (hash ^ bytes[i]) * 0x100000001B3;
+		return hash;
+	}
+
+	static void Unmap()
+	{
+		if (s_view)
+			UnmapViewOfFile(s_view);
+		if (s_mapping)
+			CloseHandle(s_mapping);
+		if (s_file != INVALID_HANDLE_VALUE)
+			CloseHandle(s_file);
+		s_file = INVALID_HANDLE_VALUE;
+		s_mapping = nullptr;
+		s_view = nullptr;
+		s_header = nullptr;
+	}
+
+	void Init()
+	{
+		ScopedLock lock(s_lock);
+		s_file = CreateFileA(GetPath().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (s_file == INVALID_HANDLE_VALUE)
+			return;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(s_file, &size) || size.QuadPart < sizeof(Header) || size.HighPart)
+		{
+			Unmap();
+			return;
+		}
+		s_mapping = CreateFileMappingA(s_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (s_mapping)
+			s_view = static_cast<const UInt8*>(MapViewOfFile(s_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!s_view)
+		{
+			Unmap();
+			return;
+		}
+
+		const auto* header = reinterpret_cast<const Header*>(s_view);
+		const UInt64 expected = sizeof(Header) + static_cast<UInt64>(header->numExpressions) * sizeof(Expression)
+			+ static_cast<UInt64>(header->numTokens) * sizeof(Token) + header->stringsSize;
+		if (header->magic != Header::kMagic || header->formatVersion != Header::kFormatVersion || header->nvseVersion != PACKED_NVSE_VERSION
+			|| expected != static_cast<UInt64>(size.QuadPart) || Hash(s_view + sizeof(Header), size.LowPart - sizeof(Header)) != header->checksum)
+		{
+			_MESSAGE("Expression cache %s is outdated or damaged, ignoring it", GetPath().c_str());
+			Unmap();
+			return;
+		}
+		s_header = header;
+		s_expressions = reinterpret_cast<const Expression*>(s_view + sizeof(Header));
+		s_tokens = reinterpret_cast<const Token*>(s_expressions + header->numExpressions);
+		s_strings = reinterpret_cast<const char*>(s_tokens + header->numTokens);
+		s_validated.assign(header->numExpressions, false);
+		_MESSAGE("Mapped expression cache with %d expressions", header->numExpressions);
+	}
+
+	// scripts created at run time get a new form ID every session
+	static bool IsCacheable(const Script* script, const UInt8* data)
+	{
+		return script && script->data && script->refID && (script->refID >> 24) != 0xFF
+			&& data >= script->data && data < static_cast<const UInt8*>(script->data) + script->info.dataLength;
+	}
+
+	static const Expression* Find(UInt32 formID, UInt32 offset)
+	{
+		const auto* end = s_expressions + s_header->numExpressions;
+		const UInt64 key = static_cast<UInt64>(formID) << 32 | offset;
+		const auto* iter = std::lower_bound(s_expressions, end, key, [](const Expression& expression, UInt64 key)
+		{
+			return expression.Key() < key;
+		});
+		return iter != end && iter->Key() == key ? iter : nullptr;
+	}
+
+	static bool RestoreToken(ExpressionEvaluator& context, const Expression& expression, const Token& stored, UInt32 idx, TokenCacheEntry& entry)
+	{
+		ScriptToken& token = entry.token;
+		token.owningScript = context.script;
+		token.context = &context;
+		token.cached = true;
+		switch (stored.type)
+		{
+		case kTokenType_Number:
+		case kTokenType_Boolean:
+			token.type = static_cast<Token_Type>(stored.type);
+			token.value.num = stored.num;
+			break;
+		case kTokenType_String:
+			if (static_cast<UInt64>(stored.data) + stored.length > s_header->stringsSize)
+				return false;
+			token.type = kTokenType_String;
+			token.InitString(s_strings + stored.data, stored.length);
+			break;
+		case kTokenType_Form:
+			token.InitRef(&context, stored.refIdx);
+			break;
+		case kTokenType_Global:
+			token.InitGlobal(&context, stored.refIdx);
+			break;
+		case kTokenType_Command:
+			token.InitCommand(stored.refIdx, stored.id, expression.offset + stored.data);
+			break;
+		case kTokenType_NumericVar:
+		case kTokenType_StringVar:
+		case kTokenType_ArrayVar:
+		case kTokenType_RefVar:
+			token.InitVariable(&context, stored.variableType, stored.refIdx, stored.id);
+			break;
+		case kTokenType_Operator:
+			if (stored.id >= kOpType_Max)
+				return false;
+			token.type = kTokenType_Operator;
+			token.value.op = &s_operators[stored.id];
+			break;
+		default:
+			return false;
+		}
+		if (!token.IsGood())
+			return false;
+
+		if (stored.rule != Token::kNoRule)
+		{
+			if (!token.IsOperator() || stored.rule >= token.GetOperator()->numRules)
+				return false;
+			entry.eval = token.GetOperator()->rules[stored.rule].eval;
+			entry.swapOrder = stored.swapOrder != 0;
+		}
+		if (stored.shortCircuitParentType != kOpType_Max && idx + stored.shortCircuitDistance >= expression.numTokens)
+			return false;
+		token.shortCircuitParentType = static_cast<OperatorType>(stored.shortCircuitParentType);
+		token.shortCircuitDistance = stored.shortCircuitDistance;
+		token.shortCircuitStackOffset = stored.shortCircuitStackOffset;
+		return true;
+	}
+
+	bool Restore(ExpressionEvaluator& context, const UInt8* data, CachedTokens& tokens)
+	{
+		Script* script = context.script;
+		if (!IsCacheable(script, data))
+			return false;
+		ScopedLock lock(s_lock);
+		if (!s_header)
+			return false;
+		const UInt32 offset = data - static_cast<const UInt8*>(script->data);
+		const Expression* expression = Find(script->refID, offset);
+		if (!expression || static_cast<UInt64>(offset) + expression->length > script->info.dataLength
+			|| static_cast<UInt64>(expression->firstToken) + expression->numTokens > s_header->numTokens
+			|| Hash(data, expression->length) != expression->hash)
+			return false;
+
+		for (UInt32 i = 0; i < expression->numTokens; i++)
+		{
+			if (!RestoreToken(context, *expression, s_tokens[expression->firstToken + i], i, *tokens.Append()))
+			{
+				tokens.Remove(0, tokens.Size());
+				return false;
+			}
+		}
+		tokens.incrementData = expression->length;
+		if (const UInt32 idx = expression - s_expressions; !s_validated[idx])
+		{
+			s_validated[idx] = true;
+			s_numValidated++;
+		}
+		return true;
+	}
+
+	static UInt8 GetRuleIndex(const TokenCacheEntry& entry)
+	{
+		if (!entry.eval)
+			return Token::kNoRule;
+		const Operator* op = entry.token.GetOperator();
+		for (UInt32 i = 0; i < op->numRules; i++)
+		{
+			if (op->rules[i].eval == entry.eval)
+				return i;
+		}
+		return Token::kNoRule;
+	}
+
+	void Record(ExpressionEvaluator& context, const UInt8* data, CachedTokens& tokens)
+	{
+		Script* script = context.script;
+		if (!IsCacheable(script, data))
+			return;
+		Recorded recorded{};
+		auto& expression = recorded.expression;
+		expression.formID = script->refID;
+		expression.offset = data - static_cast<const UInt8*>(script->data);
+		expression.length = tokens.incrementData;
+		expression.hash = Hash(data, expression.length);
+		expression.numTokens = tokens.Size();
+
+		for (auto iter = tokens.Begin(); !iter.End(); ++iter)
+		{
+			TokenCacheEntry& entry = iter.Get();
+			ScriptToken& token = entry.token;
+			Token stored{};
+			stored.type = token.Type();
+			stored.refIdx = token.refIdx;
+			stored.rule = Token::kNoRule;
+			switch (token.Type())
+			{
+			case kTokenType_Number:
+			case kTokenType_Boolean:
+				stored.num = token.value.num;
+				break;
+			case kTokenType_String:
+				stored.data = recorded.strings.size();
+				stored.length = token.strLength;
+				if (token.strLength)
+					recorded.strings.append(token.StringData(), token.strLength);
+				break;
+			case kTokenType_Form:
+			case kTokenType_Global:
+				break;
+			case kTokenType_Command:
+				stored.id = token.GetCommandInfo()->opcode;
+				stored.data = token.cmdOpcodeOffset - expression.offset;
+				break;
+			case kTokenType_NumericVar:
+			case kTokenType_StringVar:
+			case kTokenType_ArrayVar:
+			case kTokenType_RefVar:
+				stored.variableType = token.variableType;
+				stored.id = token.varIdx;
+				break;
+			case kTokenType_Operator:
+				stored.id = token.GetOperator()->type;
+				stored.rule = GetRuleIndex(entry);
+				stored.swapOrder = entry.swapOrder;
+				break;
+			default:
+				return;		// not produced by parsing, don't store what can't be restored
+			}
+			if (entry.eval && stored.rule == Token::kNoRule)
+				return;
+			stored.shortCircuitParentType = token.shortCircuitParentType;
+			stored.shortCircuitDistance = token.shortCircuitDistance;
+			stored.shortCircuitStackOffset = token.shortCircuitStackOffset;
+			recorded.tokens.push_back(stored);
+		}
+
+		ScopedLock lock(s_lock);
+		s_recorded[expression.Key()] = std::move(recorded);
+	}
+
+	void Write()
+	{
+		ScopedLock lock(s_lock);
+		const UInt32 numMapped = s_header ? s_header->numExpressions : 0;
+		if (s_recorded.empty() && s_numValidated == numMapped)
+			return;
+
+		// keep the expressions of the mapped file that were restored but not parsed again this session. The
+		// others belong to scripts that were edited, removed or not run this session and are dropped, so the
+		// file only grows with what is actually used.
+		std::vector<Expression> expressions;
+		std::vector<Token> tokens;
+		std::string strings;
+		const auto append = [&](Expression expression, const Token* first, const char* pool)
+		{
+			expression.firstToken = tokens.size();
+			for (UInt32 i = 0; i < expression.numTokens; i++)
+			{
+				Token token = first[i];
+				if (token.type == kTokenType_String)
+				{
+					token.data = strings.size();
+					strings.append(pool + first[i].data, token.length);
+				}
+				tokens.push_back(token);
+			}
+			expressions.push_back(expression);
+		};
+
+		auto recorded = s_recorded.begin();
+		for (UInt32 i = 0; i <= numMapped; i++)
+		{
+			const UInt64 key = i < numMapped ? s_expressions[i].Key() : ~0ULL;
+			for (; recorded != s_recorded.end() && recorded->first <= key; ++recorded)
+				append(recorded->second.expression, recorded->second.tokens.data(), recorded->second.strings.data());
+			if (i < numMapped && s_validated[i] && (expressions.empty() || expressions.back().Key() != key))
+				append(s_expressions[i], s_tokens + s_expressions[i].firstToken, s_strings);
+		}
+
+		Header header{};
+		header.magic = Header::kMagic;
+		header.formatVersion = Header::kFormatVersion;
+		header.nvseVersion = PACKED_NVSE_VERSION;
+		header.numExpressions = expressions.size();
+		header.numTokens = tokens.size();
+		header.stringsSize = strings.size();
+		header.checksum = Hash(expressions.data(), expressions.size() * sizeof(Expression));
+		header.checksum = Hash(tokens.data(), tokens.size() * sizeof(Token), header.checksum);
+		header.checksum = Hash(strings.data(), strings.size(), header.checksum);
+
+		const std::string path = GetPath();
+		const std::string tempPath = path + ".tmp";
+		FILE* file;
+		if (fopen_s(&file, tempPath.c_str(), "wb"))
+		{
+			_MESSAGE("Failed to write expression cache %s", tempPath.c_str());
+			return;
+		}
+		const bool written = fwrite(&header, sizeof(header), 1, file) == 1
+			&& fwrite(expressions.data(), sizeof(Expression), expressions.size(), file) == expressions.size()
+			&& fwrite(tokens.data(), sizeof(Token), tokens.size(), file) == tokens.size()
+			&& fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+		fclose(file);
+
+		// the file stays mapped until now, restoring stops here
+		Unmap();
+		s_recorded.clear();
+		s_validated.clear();
+		s_numValidated = 0;
+		if (!written || !MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			_MESSAGE("Failed to write expression cache %s", path.c_str());
+			DeleteFileA(tempPath.c_str());
+			return;
+		}
+		_MESSAGE("Wrote expression cache with %d expressions", header.numExpressions);
+	}
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#if RUNTIME
+
+class CachedTokens;
+class ExpressionEvaluator;
+
+// Parsed expressions kept across sessions, so that the scripts starting after a save load don't all parse
+// their expressions in the same frame. Expressions are keyed by the form ID of their script and their offset
+// in its data and are only used while a hash of their bytecode still matches. The tokens are stored without
+// pointers: numbers, strings, operators, bound operator rules and short circuit jumps as they are, forms,
+// globals, commands and variables as the indices the bytecode has, looked up again when restoring, as
+// ReadFrom does. The file is mapped read only by Init() and rewritten by Write() with the expressions parsed
+// or restored this session; the others are dropped.
+namespace ExpressionDiskCache
+{
+	void Init();
+
+	// fills tokens, which must be empty, if the cache has the expression at data, leaves them empty if not.
+	// data must point into the data of context.script.
+	bool Restore(ExpressionEvaluator& context, const UInt8* data, CachedTokens& tokens);
+
+	// stores tokens just parsed from data for the next session
+	void Record(ExpressionEvaluator& context, const UInt8* data, CachedTokens& tokens);
+
+	void Write();
+}
+
+#endif
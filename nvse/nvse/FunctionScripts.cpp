@@ -1,5 +1,7 @@
 #include "FunctionScripts.h"
 #include "ScriptTokens.h"
+#include "ScriptProfiler.h"
+#include "ScriptTokenCache.h"
 #include "ThreadLocal.h"
 #include "GameRTTI.h"
 
@@ -206,6 +208,8 @@ ScriptToken* UserFunctionManager::Call(FunctionCaller & caller)
 		return NULL;
 	}
 
+	ScriptProfiler::Scope profilerScope(ScriptProfiler::Kind::Function, funcScript, 0);
+
 	// create a function context for execution
 	FunctionContext* context = info->CreateContext(callerVersion, caller.GetInvokingScript());
 	if (!context)
@@ -216,6 +220,7 @@ ScriptToken* UserFunctionManager::Call(FunctionCaller & caller)
 
 	// push and execute on stack
 	ScriptToken * funcResult = NULL;
+	const UInt32 youngArrays = g_ArrayMap.BeginYoungScope();
 	funcMan->Push(context);
 
 	funcMan->m_nestDepth++;
@@ -227,6 +232,7 @@ ScriptToken* UserFunctionManager::Call(FunctionCaller & caller)
 	if (!funcMan->Pop(funcScript))
 		ShowRuntimeError(funcScript, "Call stack is corrupted on return from call to function script");
 
+	g_ArrayMap.EndYoungScope(youngArrays, funcResult && funcResult->Type() == kTokenType_Array ? funcResult->GetArray() : 0);
 	return funcResult;
 }
 
@@ -352,6 +358,7 @@ FunctionInfo::~FunctionInfo()
 		delete[] m_destructibles;
 
 	GameHeapFree(m_eventList);
+	VarCache::Invalidate();
 }
 
 FunctionContext* FunctionInfo::CreateContext(UInt8 version, Script* invokingScript)
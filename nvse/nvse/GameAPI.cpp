@@ -11,6 +11,7 @@
 #if NVSE_CORE
 #include "Hooks_Script.h"
 #include "ScriptUtils.h"
+#include "ScriptTokenCache.h"
 #include "Hooks_Other.h"
 #endif
 
@@ -258,6 +259,7 @@ void ScriptEventList::Destructor()
 		FormHeap_Free(m_vars);
 		m_vars = next;
 	}
+	VarCache::Invalidate();
 }
 
 tList<ScriptEventList::Var>* ScriptEventList::GetVars() const
@@ -4,6 +4,7 @@
 #include "GameObjects.h"
 #include "CommandTable.h"
 #include "GameRTTI.h"
+#include "ScriptTokenCache.h"
 
 UInt32 GetDeclaredVariableType(const char* varName, const char* scriptText)
 {
@@ -153,6 +154,7 @@ bool Script::RunScriptLine2(const char * text, TESObjectREFR* object, bool bSupp
 	CALL_MEMBER_FN(script, MarkAsTemporary)();
 	CALL_MEMBER_FN(script, SetText)(text);
 	bool bResult = CALL_MEMBER_FN(script, Run)(consoleManager->scriptContext, true, object);
+	TokenCache::InvalidateScript(script);	// the next temporary script will likely get the same data address
 	CALL_MEMBER_FN(script, Destructor)();
 
 	//ToggleConsoleOutput(true);
@@ -16,6 +16,7 @@
 #include "EventManager.h"
 #include "Hooks_Other.h"
 #include "ScriptTokenCache.h"
+#include "ExpressionDiskCache.h"
 
 static void HandleMainLoopHook(void);
 
@@ -78,7 +79,7 @@ static void HandleMainLoopHook(void)
 	EventManager::Tick();
 
 	// clean up any temp arrays/strings (moved after deffered processing because of array parameter to User Defined Events)
-	g_ArrayMap.Clean();
+	g_ArrayMap.Collect(ArrayVarMap::kCollectBudget);
 	g_StringMap.Clean();
 }
 
@@ -184,6 +185,8 @@ void __stdcall SendQuitGameMessage(QuitGameMessage msg)
 		msgToSend = NVSEMessagingInterface::kMessage_ExitGame_Console;
 
 	PluginManager::Dispatch_Message(0, msgToSend, NULL, 0, NULL);
+	if (msg != kQuit_ToMainMenu)
+		ExpressionDiskCache::Write();
 //	handled by Dispatch_Message EventManager::HandleNVSEMessage(msgToSend, NULL);
 }
 
@@ -8,6 +8,7 @@
 
 #if RUNTIME
 #include "EventManager.h"
+#include "ScriptTokenCache.h"
 
 bool g_gameLoaded = false;
 bool g_gameStarted = false;	// remains true as long as a game is loaded. TBD: Should be cleared when exiting to MainMenu.
@@ -55,6 +56,7 @@ static void __stdcall DoPreLoadGameHook(const char* saveFilePath)
 {
 	g_gameStarted = false;
 	s_saveFilePath = (const char *)saveFilePath;
+	VarCache::Invalidate();	// the game frees the event lists of all loaded forms
 	_MESSAGE("NVSE DLL DoPreLoadGameHook: %s", saveFilePath);
 	Serialization::HandlePreLoadGame(saveFilePath);
 }
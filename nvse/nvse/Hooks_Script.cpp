@@ -2,8 +2,10 @@
 #include "Hooks_Script.h"
 #include "GameForms.h"
 #include "GameScript.h"
+#include "GameExtraData.h"
 #include "ScriptUtils.h"
 #include "CommandTable.h"
+#include "ScriptTokenCache.h"
 #include <stack>
 #include <string>
 
@@ -33,6 +35,11 @@ static const UInt32 kExtractArgsReadNumArgsPatchAddr = 0x005ACCD4;	// FalloutNV
 static const UInt32 kExtractArgsReadNumArgsRetnAddr = 0x005ACCE9;	// FalloutNV uses a different sequence, see the end of this file
 static const UInt32 kExtractArgsNoArgsPatchAddr = 0x005ACD07;			// jle kExtractArgsEndProcAddr (if num args == 0)
 
+static const UInt32 kVtbl_Script = 0x01037094;
+static UInt32 s_scriptDestroyAddr;	// original scalar deleting destructor, slot 0 of the vtable
+static const UInt32 kVtbl_ExtraScript = 0x01015914;
+static UInt32 s_extraScriptDestroyAddr;
+
 static const UInt32 kScriptRunner_RunHookAddr = 0x005E0D51;	// Start from Script::Execute, second call after pushing "all" arguments, take 3rd call from the end (present twice)
 static const UInt32 kScriptRunner_RunRetnAddr = kScriptRunner_RunHookAddr + 5;
 static const UInt32 kScriptRunner_RunCallAddr = 0x00702FC0;			// overwritten call
@@ -121,10 +128,31 @@ static __declspec(naked) void ExpressionParserBufferOverflowHook_2(void)
 	}
 }
 
+// drop cached tokens keyed on the data of a script that is going away, before the allocator can reuse the address
+void* __fastcall ScriptDestroyHook(Script* script, void* edx, bool doFree)
+{
+	TokenCache::InvalidateScript(script);
+	return ThisStdCall<void*>(s_scriptDestroyAddr, script, doFree);
+}
+
+// the game frees the event list of a reference together with its ExtraScript
+void* __fastcall ExtraScriptDestroyHook(ExtraScript* xScript, void* edx, bool doFree)
+{
+	if (xScript->eventList)
+		VarCache::Invalidate();
+	return ThisStdCall<void*>(s_extraScriptDestroyAddr, xScript, doFree);
+}
+
 void Hook_Script_Init()
 {
 	WriteRelJump(ExtractStringPatchAddr, (UInt32)&ExtractStringHook);
 
+	s_scriptDestroyAddr = *(UInt32*)kVtbl_Script;
+	SafeWrite32(kVtbl_Script, (UInt32)ScriptDestroyHook);
+
+	s_extraScriptDestroyAddr = *(UInt32*)kVtbl_ExtraScript;
+	SafeWrite32(kVtbl_ExtraScript, (UInt32)ExtraScriptDestroyHook);
+
 	// patch the "apple bug"
 	// game caches information about the most recently retrieved RefVariable for the current executing script
 	// if same refIdx requested twice in a row returns previously returned ref without
@@ -540,8 +568,11 @@ namespace CompilerOverride {
 	}
 }
 
-bool __stdcall HandleBeginCompile(ScriptBuffer* buf)
+bool __stdcall HandleBeginCompile(Script* script, ScriptBuffer* buf)
 {
+	// the script's data is about to be replaced
+	TokenCache::InvalidateScript(script);
+
 	// empty out the loop stack
 	while (s_loopStartOffsets.size())
 		s_loopStartOffsets.pop();
@@ -568,6 +599,7 @@ static __declspec(naked) void CompileScriptHook(void)
 		mov		eax, [esp + 4]					// grab the second arg (ScriptBuffer*)
 		pushad
 		push	eax
+		push	dword ptr [esp + 0x24]			// and the first (Script*), past pushad and the push above
 		call	HandleBeginCompile				// Precompile
 		mov[precompileResult], al			// save result
 		popad
@@ -253,6 +253,12 @@ static ParamInfo kParams_OneForm_OneInt[2] =
 	{	"int",	kParamType_Integer, 0	}, 
 };
 
+static ParamInfo kParams_OneForm_OneOptionalInt[2] =
+{
+	{	"form",	kParamType_AnyForm,	0	},
+	{	"int",	kParamType_Integer, 1	},
+};
+
 static ParamInfo kParams_OneForm[1] =
 {
 	{	"form",	kParamType_AnyForm,	0	},
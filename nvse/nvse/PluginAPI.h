@@ -233,7 +233,7 @@ struct NVSEMessagingInterface
 
 // added for kVersion == 4 (xNVSE)
 		kMessage_DeferredInit,
-		kMessage_ClearScriptDataCache,
+		kMessage_ClearScriptDataCache,	// dataLen: 0, data: NULL, or dataLen: 4, data: Script* if only that script's data was cleared
 		kMessage_MainGameLoop,			// called each game loop
 	};
 
@@ -482,7 +482,7 @@ struct NVSEScriptInterface
 struct NVSEDataInterface
 {
 	enum {
-		kVersion = 2
+		kVersion = 3
 	};
 
 	UInt32		version;
@@ -513,6 +513,8 @@ struct NVSEDataInterface
 	void * (* GetData)(UInt32 dataID);
 	// v2: xNVSE caches script data for additional performance and short circuit evaluation, if you are manipulating script data then you can clear the cache 
 	void (*ClearScriptDataCache)();
+	// v3: clears only the cached data of one script, call it after recompiling or before freeing a script
+	void (*ClearScriptDataCacheForScript)(Script* script);
 };
 #endif
 
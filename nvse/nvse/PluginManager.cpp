@@ -120,7 +120,8 @@ static const NVSEDataInterface g_NVSEDataInterface =
 	PluginManager::GetSingleton,
 	PluginManager::GetFunc,
 	PluginManager::GetData,
-	PluginManager::ClearScriptDataCache
+	PluginManager::ClearScriptDataCache,
+	PluginManager::ClearScriptDataCacheForScript
 };
 #endif
 
@@ -884,6 +885,12 @@ void PluginManager::ClearScriptDataCache()
 	Dispatch_Message(0, NVSEMessagingInterface::kMessage_ClearScriptDataCache, NULL, 0, NULL);
 }
 
+void PluginManager::ClearScriptDataCacheForScript(Script* script)
+{
+	TokenCache::InvalidateScript(script);
+	Dispatch_Message(0, NVSEMessagingInterface::kMessage_ClearScriptDataCache, script, sizeof(Script*), NULL);
+}
+
 
 bool Cmd_IsPluginInstalled_Execute(COMMAND_ARGS)
 {
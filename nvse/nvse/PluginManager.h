@@ -39,6 +39,7 @@ public:
 	static void * GetFunc(UInt32 funcID);
 	static void * GetData(UInt32 dataID);
 	static void ClearScriptDataCache();
+	static void ClearScriptDataCacheForScript(Script* script);
 
 private:
 	struct LoadedPlugin
@@ -0,0 +1,415 @@
+#include "ScriptProfiler.h"
+
+#if RUNTIME
+#include <algorithm>
+#include <intrin.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GameAPI.h"
+#include "GameForms.h"
+#include "Utilities.h"
+
+namespace ScriptProfiler
+{
+	std::atomic<bool> g_enabled = false;
+
+	// counters are only written by the owning thread, except for samples which only the sampler writes
+	struct Entry
+	{
+		std::atomic<bool>	used = false;
+		Kind				kind = Kind::Expression;
+		UInt32				refID = 0;
+		UInt32				offset = 0;
+		UInt32				id = 0;
+		const char*			label = nullptr;
+		std::atomic<UInt32>	calls = 0;
+		std::atomic<UInt32>	samples = 0;
+		std::atomic<UInt64>	totalCycles = 0;
+		std::atomic<UInt64>	selfCycles = 0;
+
+		bool Matches(Kind kind_, UInt32 refID_, UInt32 offset_, UInt32 id_) const
+		{
+			return kind == kind_ && refID == refID_ && offset == offset_ && id == id_;
+		}
+
+		void Clear()
+		{
+			used.store(false, std::memory_order_relaxed);
+			calls.store(0, std::memory_order_relaxed);
+			samples.store(0, std::memory_order_relaxed);
+			totalCycles.store(0, std::memory_order_relaxed);
+			selfCycles.store(0, std::memory_order_relaxed);
+		}
+	};
+
+	struct TraceEvent
+	{
+		UInt64	start;
+		UInt64	cycles;
+		UInt32	entry;
+	};
+
+	template <typename T>
+	void Add(std::atomic<T>& counter, T value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	// One per thread that ran a scope while profiling. The table is open addressed and fixed size so
+	// that readers never see it move; keys that find no free slot within kMaxProbes are dropped.
+	struct ThreadProfile
+	{
+		static constexpr UInt32 kNumEntries = 0x1000;
+		static constexpr UInt32 kMaxProbes = 32;
+		static constexpr UInt32 kTraceCapacity = 0x40000;
+
+		Entry							entries[kNumEntries];
+		std::unique_ptr<TraceEvent[]>	trace;
+		std::atomic<UInt32>				traceCount = 0;
+		std::atomic<UInt32>				dropped = 0;
+		std::atomic<UInt32>				generation = 0;
+		std::atomic<Entry*>				current = nullptr;	// innermost entry, read by the sampler
+		Scope*							scope = nullptr;	// innermost scope
+		UInt32							threadID = GetCurrentThreadId();
+
+		static UInt32 Hash(Kind kind, UInt32 refID, UInt32 offset, UInt32 id)
+		{
+			UInt32 hash = refID * 0x9E3779B1 ^ offset * 0x85EBCA77 ^ id * 0xC2B2AE3D ^ static_cast<UInt32>(kind);
+			return hash ^ hash >> 16;
+		}
+
+		Entry* Find(Kind kind, UInt32 refID, UInt32 offset, UInt32 id, const char* label)
+		{
+			UInt32 idx = Hash(kind, refID, offset, id);
+			for (UInt32 probe = 0; probe < kMaxProbes; ++probe, ++idx)
+			{
+				Entry& entry = entries[idx & (kNumEntries - 1)];
+				if (!entry.used.load(std::memory_order_relaxed))
+				{
+					entry.kind = kind;
+					entry.refID = refID;
+					entry.offset = offset;
+					entry.id = id;
+					entry.label = label;
+					entry.used.store(true, std::memory_order_release);
+					return &entry;
+				}
+				if (entry.Matches(kind, refID, offset, id))
+					return &entry;
+			}
+			Add(dropped, 1U);
+			return nullptr;
+		}
+
+		void Reset(UInt32 newGeneration, bool tracing)
+		{
+			for (auto& entry : entries)
+				entry.Clear();
+			if (tracing && !trace)
+				trace = std::make_unique<TraceEvent[]>(kTraceCapacity);
+			else if (!tracing)
+				trace.reset();
+			traceCount.store(0, std::memory_order_relaxed);
+			dropped.store(0, std::memory_order_relaxed);
+			generation.store(newGeneration, std::memory_order_release);
+		}
+	};
+
+	static ICriticalSection s_lock;
+	static std::vector<ThreadProfile*> s_threads;	// never freed, a thread may still be inside a scope
+	static std::atomic<UInt32> s_generation = 0;
+	static std::atomic<bool> s_tracing = false;
+	static HANDLE s_sampler = nullptr;
+	static HANDLE s_stopSampler = nullptr;
+
+	// to convert cycles to time
+	static UInt64 s_startCycles = 0;
+	static UInt64 s_stopCycles = 0;
+	static LARGE_INTEGER s_startTime = {};
+	static LARGE_INTEGER s_stopTime = {};
+
+	static thread_local ThreadProfile* t_profile = nullptr;
+
+	static ThreadProfile* GetThreadProfile()
+	{
+		if (!t_profile)
+		{
+			t_profile = new ThreadProfile;
+			ScopedLock lock(s_lock);
+			s_threads.push_back(t_profile);
+		}
+		const auto generation = s_generation.load(std::memory_order_relaxed);
+		if (t_profile->generation.load(std::memory_order_relaxed) != generation)
+			t_profile->Reset(generation, s_tracing.load(std::memory_order_relaxed));
+		return t_profile;
+	}
+
+	void Scope::Begin(Kind kind, const Script* script, UInt32 offset, UInt32 id, const char* label)
+	{
+		ThreadProfile* profile = GetThreadProfile();
+		entry_ = profile->Find(kind, script ? script->refID : 0, offset, id, label);
+		if (!entry_)
+			return;
+		parent_ = profile->scope;
+		profile->scope = this;
+		profile->current.store(entry_, std::memory_order_relaxed);
+		generation_ = profile->generation.load(std::memory_order_relaxed);
+		start_ = __rdtsc();
+	}
+
+	void Scope::End()
+	{
+		const UInt64 cycles = __rdtsc() - start_;
+		ThreadProfile* profile = t_profile;
+		profile->scope = parent_;
+		profile->current.store(parent_ ? parent_->entry_ : nullptr, std::memory_order_relaxed);
+		if (parent_)
+			parent_->childCycles_ += cycles;
+
+		// profiling was restarted by a nested scope, entry_ belongs to the previous run
+		if (generation_ != profile->generation.load(std::memory_order_relaxed))
+			return;
+
+		Add(entry_->calls, 1U);
+		Add(entry_->totalCycles, cycles);
+		Add(entry_->selfCycles, cycles - childCycles_);
+
+		if (profile->trace)
+		{
+			const auto count = profile->traceCount.load(std::memory_order_relaxed);
+			if (count < ThreadProfile::kTraceCapacity)
+			{
+				profile->trace[count] = { start_, cycles, static_cast<UInt32>(entry_ - profile->entries) };
+				profile->traceCount.store(count + 1, std::memory_order_release);
+			}
+			else
+			{
+				Add(profile->dropped, 1U);
+			}
+		}
+	}
+
+	static DWORD WINAPI SamplerThread(LPVOID)
+	{
+		while (WaitForSingleObject(s_stopSampler, 1) == WAIT_TIMEOUT)
+		{
+			ScopedLock lock(s_lock);
+			for (auto* profile : s_threads)
+			{
+				if (auto* entry = profile->current.load(std::memory_order_relaxed))
+					entry->samples.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		return 0;
+	}
+
+	void Start(bool trace)
+	{
+		Stop();
+		s_tracing = trace;
+		s_generation.fetch_add(1);
+		QueryPerformanceCounter(&s_startTime);
+		s_startCycles = __rdtsc();
+		s_stopSampler = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		s_sampler = CreateThread(nullptr, 0, SamplerThread, nullptr, 0, nullptr);
+		g_enabled = true;
+	}
+
+	void Stop()
+	{
+		if (!g_enabled.exchange(false))
+			return;
+		SetEvent(s_stopSampler);
+		WaitForSingleObject(s_sampler, INFINITE);
+		CloseHandle(s_sampler);
+		CloseHandle(s_stopSampler);
+		s_sampler = s_stopSampler = nullptr;
+		QueryPerformanceCounter(&s_stopTime);
+		s_stopCycles = __rdtsc();
+	}
+
+	bool IsRunning()
+	{
+		return g_enabled;
+	}
+
+	// returns the profiled time in milliseconds and the number of cycles in a microsecond
+	static double GetElapsed(double& cyclesPerMicrosecond)
+	{
+		LARGE_INTEGER frequency, stopTime = s_stopTime;
+		UInt64 stopCycles = s_stopCycles;
+		if (g_enabled)
+		{
+			QueryPerformanceCounter(&stopTime);
+			stopCycles = __rdtsc();
+		}
+		QueryPerformanceFrequency(&frequency);
+		const double microseconds = (stopTime.QuadPart - s_startTime.QuadPart) * 1000000.0 / frequency.QuadPart;
+		cyclesPerMicrosecond = microseconds > 0 ? (stopCycles - s_startCycles) / microseconds : 1;
+		return microseconds / 1000;
+	}
+
+	static bool IsCurrent(const ThreadProfile* profile)
+	{
+		return profile->generation.load(std::memory_order_acquire) == s_generation.load(std::memory_order_relaxed);
+	}
+
+	static std::string Describe(const Entry& entry)
+	{
+		if (entry.kind == Kind::Event)
+			return FormatString("event %s", entry.label);
+
+		const auto* form = entry.refID ? LookupFormByID(entry.refID) : nullptr;
+		const auto* name = form ? form->GetName() : nullptr;
+		const auto script = name && *name ? FormatString("%08X (%s)", entry.refID, name) : FormatString("%08X", entry.refID);
+		switch (entry.kind)
+		{
+		case Kind::Expression:
+			return FormatString("script %s offset %04X", script.c_str(), entry.offset);
+		case Kind::Command:
+			return FormatString("%s in script %s offset %04X", entry.label, script.c_str(), entry.offset);
+		default:
+			return FormatString("function %s", script.c_str());
+		}
+	}
+
+	struct Total
+	{
+		const Entry*	entry;
+		UInt64			calls;
+		UInt64			samples;
+		UInt64			totalCycles;
+		UInt64			selfCycles;
+	};
+
+	// entries of all threads with equal keys summed up
+	static std::vector<Total> Collect(UInt32& dropped)
+	{
+		std::vector<Total> totals;
+		dropped = 0;
+		ScopedLock lock(s_lock);
+		for (const auto* profile : s_threads)
+		{
+			if (!IsCurrent(profile))
+				continue;
+			dropped += profile->dropped.load(std::memory_order_relaxed);
+			for (const auto& entry : profile->entries)
+			{
+				if (!entry.used.load(std::memory_order_acquire))
+					continue;
+				totals.push_back({ &entry, entry.calls.load(std::memory_order_relaxed), entry.samples.load(std::memory_order_relaxed),
+					entry.totalCycles.load(std::memory_order_relaxed), entry.selfCycles.load(std::memory_order_relaxed) });
+			}
+		}
+
+		const auto keyLess = [](const Total& lhs, const Total& rhs)
+		{
+			const Entry& l = *lhs.entry, & r = *rhs.entry;
+			if (l.kind != r.kind) return l.kind < r.kind;
+			if (l.refID != r.refID) return l.refID < r.refID;
+			if (l.offset != r.offset) return l.offset < r.offset;
+			return l.id < r.id;
+		};
+		std::sort(totals.begin(), totals.end(), keyLess);
+
+		UInt32 merged = 0;
+		for (UInt32 i = 0; i < totals.size(); ++i)
+		{
+			if (merged && !keyLess(totals[merged - 1], totals[i]))
+			{
+				auto& total = totals[merged - 1];
+				total.calls += totals[i].calls;
+				total.samples += totals[i].samples;
+				total.totalCycles += totals[i].totalCycles;
+				total.selfCycles += totals[i].selfCycles;
+			}
+			else
+			{
+				totals[merged++] = totals[i];
+			}
+		}
+		totals.resize(merged);
+		return totals;
+	}
+
+	static void Print(const char* fmt, ...)
+	{
+		va_list args;
+		va_start(args, fmt);
+		char buffer[0x400];
+		vsprintf_s(buffer, sizeof(buffer), fmt, args);
+		va_end(args);
+		Console_Print("%s", buffer);
+		_MESSAGE("%s", buffer);
+	}
+
+	void PrintReport(UInt32 maxEntries)
+	{
+		double cyclesPerMicrosecond;
+		const double elapsed = GetElapsed(cyclesPerMicrosecond);
+		UInt32 dropped;
+		auto totals = Collect(dropped);
+		std::sort(totals.begin(), totals.end(), [](const Total& lhs, const Total& rhs) { return lhs.selfCycles > rhs.selfCycles; });
+
+		Print("Script profile: %.1f ms, %u entries, %u dropped", elapsed, static_cast<UInt32>(totals.size()), dropped);
+		Print("   self ms  total ms     calls  samples");
+		const double cyclesPerMillisecond = cyclesPerMicrosecond * 1000;
+		for (UInt32 i = 0; i < totals.size() && i < maxEntries; ++i)
+		{
+			const auto& total = totals[i];
+			Print("%10.3f %9.3f %9llu %8llu  %s", total.selfCycles / cyclesPerMillisecond, total.totalCycles / cyclesPerMillisecond,
+				total.calls, total.samples, Describe(*total.entry).c_str());
+		}
+	}
+
+	static void WriteJsonString(FILE* file, const std::string& str)
+	{
+		fputc('"', file);
+		for (const char c : str)
+		{
+			if (c == '"' || c == '\\')
+				fputc('\\', file);
+			if (static_cast<UInt8>(c) >= ' ')
+				fputc(c, file);
+		}
+		fputc('"', file);
+	}
+
+	SInt32 WriteTrace(const char* path)
+	{
+		FILE* file;
+		if (fopen_s(&file, path, "w"))
+			return -1;
+
+		static const char* kKindNames[] = { "expression", "command", "function", "event" };
+		double cyclesPerMicrosecond;
+		GetElapsed(cyclesPerMicrosecond);
+		SInt32 numEvents = 0;
+
+		fputs("{\"traceEvents\":[\n", file);
+		ScopedLock lock(s_lock);
+		for (const auto* profile : s_threads)
+		{
+			if (!IsCurrent(profile) || !profile->trace)
+				continue;
+			const auto count = profile->traceCount.load(std::memory_order_acquire);
+			for (UInt32 i = 0; i < count; ++i)
+			{
+				const auto& event = profile->trace[i];
+				const auto& entry = profile->entries[event.entry];
+				fputs(numEvents++ ? ",\n{\"name\":" : "{\"name\":", file);
+				WriteJsonString(file, Describe(entry));
+				fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					kKindNames[static_cast<UInt32>(entry.kind)], profile->threadID,
+					(event.start - s_startCycles) / cyclesPerMicrosecond, event.cycles / cyclesPerMicrosecond);
+			}
+		}
+		fputs("\n]}\n", file);
+		fclose(file);
+		return numEvents;
+	}
+}
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+#if RUNTIME
+#include <atomic>
+
+class Script;
+
+// Profiler for script execution, started and stopped with the ProfileScripts console command.
+// Expressions, the commands they call, user function calls and event dispatches are timed with the
+// time stamp counter and aggregated per script, offset and command into a table owned by the running
+// thread, so recording takes no locks; the console only reads these tables to build a report or a
+// Chrome trace. While running, a sampler thread also counts which entry each thread is in once per
+// millisecond. Self time excludes the time spent in nested entries. When stopped, a scope costs one
+// relaxed load and a branch.
+namespace ScriptProfiler
+{
+	enum class Kind : UInt8
+	{
+		Expression,		// offset of the expression in the script data
+		Command,		// id: opcode, label: command name
+		Function,		// script of the called user function
+		Event,			// id: event id, label: event name
+	};
+
+	struct Entry;
+
+	extern std::atomic<bool> g_enabled;
+
+	class Scope
+	{
+		Entry*	entry_ = nullptr;
+		Scope*	parent_ = nullptr;
+		UInt64	start_ = 0;
+		UInt64	childCycles_ = 0;
+		UInt32	generation_ = 0;
+
+		void Begin(Kind kind, const Script* script, UInt32 offset, UInt32 id, const char* label);
+		void End();
+
+	public:
+		Scope(Kind kind, const Script* script, UInt32 offset, UInt32 id = 0, const char* label = nullptr)
+		{
+			if (g_enabled.load(std::memory_order_relaxed))
+				Begin(kind, script, offset, id, label);
+		}
+
+		~Scope()
+		{
+			if (entry_)
+				End();
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+	// discards the results of the previous run, trace additionally records every scope for WriteTrace
+	void Start(bool trace);
+	void Stop();
+	bool IsRunning();
+
+	// prints the entries with the most self time to the console and the log
+	void PrintReport(UInt32 maxEntries);
+
+	// writes the recorded scopes in Chrome trace event format, returns the number of events or -1
+	SInt32 WriteTrace(const char* path);
+}
+
+#endif
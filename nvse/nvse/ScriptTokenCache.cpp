@@ -2,6 +2,16 @@
 
 #include <atomic>
 
+#include "ScriptTokenCompiler.h"
+#include "Utilities.h"
+
+CachedTokens::~CachedTokens()
+{
+#if RUNTIME
+	delete compiled;
+#endif
+}
+
 TokenCacheEntry& CachedTokens::Get(std::size_t key)
 {
 	return this->container_[key];
@@ -12,6 +22,16 @@ TokenCacheEntry* CachedTokens::Append(ExpressionEvaluator &expEval)
 	return this->container_.Append(expEval);
 }
 
+TokenCacheEntry* CachedTokens::Append()
+{
+	return this->container_.Append();
+}
+
+void CachedTokens::Remove(std::size_t key, std::size_t count)
+{
+	this->container_.RemoveRange(key, count);
+}
+
 std::size_t CachedTokens::Size() const
 {
 	return container_.Size();
@@ -32,14 +52,38 @@ TokenCacheEntry* CachedTokens::DataEnd()
 	return container_.Data() + container_.Size();
 }
 
-CachedTokens& TokenCache::Get(UInt8* key)
+void CachedTokens::AssignStateSlots()
 {
-	if (tlsClearAllCookie_ != tlsClearAllToken_)
+	numVars = numBindings = 0;
+	for (auto iter = Begin(); !iter.End(); ++iter)
 	{
-		tlsClearAllToken_ = tlsClearAllCookie_;
-		cache_.Clear();
-	} 
-	return cache_[key];
+		auto& entry = iter.Get();
+		if (entry.token.IsVariable())
+			entry.stateIdx = numVars++;
+		else if (entry.token.IsOperator() && !entry.eval)
+			entry.stateIdx = numBindings++;
+	}
+}
+
+void TokenEvalState::Init(CachedTokens& tokens)
+{
+	vars.clear();
+	vars.reserve(tokens.numVars);
+	for (auto iter = tokens.Begin(); !iter.End(); ++iter)
+	{
+		if (iter.Get().token.IsVariable())
+			vars.push_back(iter.Get().token);
+	}
+	varCaches.assign(tokens.numVars, VarCache());
+	bindings.assign(tokens.numBindings, Binding());
+}
+
+TokenCache::Entry& TokenCache::Get(UInt8* key)
+{
+	auto& entry = cache_[key];
+	if (entry.tokens && entry.tokens->invalidated.load(std::memory_order_relaxed))
+		entry.tokens.reset();
+	return entry;
 }
 
 void TokenCache::Clear()
@@ -58,10 +102,44 @@ bool TokenCache::Empty() const
 	return cache_.Empty();
 }
 
+std::shared_ptr<CachedTokens> TokenCache::FindShared(UInt8* key)
+{
+	ScopedLock lock(s_sharedLock);
+	auto* tokens = s_shared.GetPtr(key);
+	return tokens ? *tokens : nullptr;
+}
+
+std::shared_ptr<CachedTokens> TokenCache::Publish(UInt8* key, std::shared_ptr<CachedTokens> tokens)
+{
+	ScopedLock lock(s_sharedLock);
+	auto& shared = s_shared[key];
+	if (!shared)
+		shared = std::move(tokens);
+	return shared;
+}
+
+void TokenCache::InvalidateScript(Script* script)
+{
+	auto* begin = static_cast<UInt8*>(script->data);
+	auto* end = begin + script->info.dataLength;
+	ScopedLock lock(s_sharedLock);
+	for (auto iter = s_shared.Begin(); !iter.End(); ++iter)
+	{
+		if (iter.Key() < begin || iter.Key() >= end)
+			continue;
+		iter.Get()->invalidated = true;
+		iter.Remove();
+	}
+}
+
 void TokenCache::MarkForClear()
 {
-	++tlsClearAllCookie_;
+	ScopedLock lock(s_sharedLock);
+	for (auto iter = s_shared.Begin(); !iter.End(); ++iter)
+		iter.Get()->invalidated = true;
+	s_shared.Clear();
 }
 
-std::atomic<int> TokenCache::tlsClearAllCookie_ = 0;
-thread_local int TokenCache::tlsClearAllToken_ = 0;
\ No newline at end of file
+std::atomic<UInt32> VarCache::s_generation = 0;
+ICriticalSection TokenCache::s_sharedLock;
+UnorderedMap<UInt8*, std::shared_ptr<CachedTokens>> TokenCache::s_shared;
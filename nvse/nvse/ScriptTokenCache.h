@@ -1,38 +1,140 @@
 #pragma once
 #include "containers.h"
 #include "ScriptTokens.h"
+#include "common/ICriticalSection.h"
 #include <atomic>
+#include <memory>
+#include <vector>
+
+class CompiledExpression;
+
 struct TokenCacheEntry
 {
 	ScriptToken		token;
-	Op_Eval			eval;
+	Op_Eval			eval;		// bound when parsing if the operand types are known by then
 	bool			swapOrder;
+	UInt16			stateIdx;	// variables and operators bound at run time: index of their slot in TokenEvalState
+
+	TokenCacheEntry(ExpressionEvaluator &expEval) : token(expEval), eval(nullptr), swapOrder(false), stateIdx(0) {}
+	TokenCacheEntry() : eval(nullptr), swapOrder(false), stateIdx(0) {}
+};
 
-	TokenCacheEntry(ExpressionEvaluator &expEval) : token(expEval), eval(nullptr), swapOrder(false) {}
+// shapes of 'if eval' conditions that ExpressionEvaluator::EvaluateCondition() runs without creating tokens
+enum class ConditionShape : UInt8
+{
+	Generic,			// evaluated like any other expression, then GetBool()
+	Compiled,			// see CompiledExpression
+	Command,			// a command returning a number or a form
+	CompareCommand,		// a command returning a number compared to a number literal, in either order
 };
 
+// A parsed expression. Once published it is shared by all threads and only read, whatever changes while
+// evaluating it is kept in the TokenEvalState of each thread.
 class CachedTokens
 {
 	Vector<TokenCacheEntry> container_;
 public:
 	std::size_t incrementData;
+	CompiledExpression* compiled = nullptr;	// register machine version of the tokens, null if they can't be compiled
+	ConditionShape condition = ConditionShape::Generic;
+	UInt16 numVars = 0;
+	UInt16 numBindings = 0;
+	std::atomic<bool> invalidated = false;	// script was recompiled or freed, parse again
+
+	CachedTokens() = default;
+	~CachedTokens();
 	[[nodiscard]] TokenCacheEntry& Get(std::size_t key);
 	TokenCacheEntry* Append(ExpressionEvaluator &expEval);
+	TokenCacheEntry* Append();
+	void Remove(std::size_t key, std::size_t count);
 	[[nodiscard]] std::size_t Size() const;
 	[[nodiscard]] bool Empty() const;
 	Vector<TokenCacheEntry>::Iterator Begin();
 	TokenCacheEntry *DataEnd();
+	void AssignStateSlots();
+};
+
+// The Var a variable token resolved to last time, reused while it is looked up in the same event list.
+// The cached Var is never read to validate it: a list keeps its vars until it is freed, and every free of
+// a list that can be cached bumps the generation. NVSE bumps it where it frees lists (user function calls,
+// loading a save) and the game's ExtraScript destructor is hooked for the lists of references. Lists of
+// magic effect and other scripts are freed by game code that is not hooked and are never cached.
+struct VarCache
+{
+	ScriptEventList*			eventList = nullptr;
+	ScriptEventList::VarEntry*	firstEntry = nullptr;
+	ScriptEventList::Var*		var = nullptr;
+	UInt32						generation = 0;
+
+	static std::atomic<UInt32> s_generation;
+
+	ScriptEventList::Var* Get(ScriptEventList* list) const
+	{
+		if (list == eventList && generation == s_generation.load(std::memory_order_relaxed) && list->m_vars == firstEntry)
+			return var;
+		return nullptr;
+	}
+
+	static bool CanCache(const ScriptEventList* list)
+	{
+		return list->m_script && (list->m_script->IsObjectScript() || list->m_script->IsQuestScript());
+	}
+
+	void Set(ScriptEventList* list, ScriptEventList::Var* listVar)
+	{
+		if (!CanCache(list))
+			return;
+		eventList = list;
+		firstEntry = list->m_vars;
+		var = listVar;
+		generation = s_generation.load(std::memory_order_relaxed);
+	}
+
+	// call after event lists were or may have been freed
+	static void Invalidate() { s_generation.fetch_add(1, std::memory_order_relaxed); }
+};
+
+// the per thread part of a CachedTokens
+struct TokenEvalState
+{
+	struct Binding
+	{
+		Op_Eval	eval = nullptr;
+		bool	swapOrder = false;
+	};
+
+	std::vector<ScriptToken>	vars;		// copies of the variable tokens, resolved on each evaluation
+	std::vector<VarCache>		varCaches;	// one per entry of vars
+	std::vector<Binding>		bindings;	// rules picked by Operator::Evaluate for operators not bound when parsing
+
+	void Init(CachedTokens& tokens);
 };
 
+// Parsed expressions keyed by the address of their bytecode. The tokens are parsed once by whichever
+// thread gets to them first and then shared with the others; each thread keeps its own evaluation state.
 class TokenCache
 {
-	UnorderedMap<UInt8*, CachedTokens> cache_;
-	static std::atomic<int> tlsClearAllCookie_;
-	static thread_local int tlsClearAllToken_;
 public:
-	CachedTokens& Get(UInt8* key);
+	struct Entry
+	{
+		std::shared_ptr<CachedTokens>	tokens;	// null if not looked up by this thread yet or invalidated since
+		TokenEvalState					state;
+	};
+
+private:
+	UnorderedMap<UInt8*, Entry> cache_;
+	static ICriticalSection s_sharedLock;
+	static UnorderedMap<UInt8*, std::shared_ptr<CachedTokens>> s_shared;
+
+public:
+	Entry& Get(UInt8* key);
 	void Clear();
 	[[nodiscard]] std::size_t Size() const;
 	bool Empty() const;
+
+	static std::shared_ptr<CachedTokens> FindShared(UInt8* key);
+	// returns the tokens another thread published in the meantime if there are any
+	static std::shared_ptr<CachedTokens> Publish(UInt8* key, std::shared_ptr<CachedTokens> tokens);
+	static void InvalidateScript(Script* script);
 	static void MarkForClear();
-};
\ No newline at end of file
+};
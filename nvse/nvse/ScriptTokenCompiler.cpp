@@ -0,0 +1,412 @@
+#include "ScriptTokenCompiler.h"
+
+#if RUNTIME
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include "ScriptTokenCache.h"
+#include "ScriptUtils.h"
+
+ScriptToken* Eval_Comp_Number_Number(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_Eq_Number(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_Logical(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_Add_Number(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_Arithmetic(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_Integer(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_Assign_Numeric(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_PlusEquals_Number(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_MinusEquals_Number(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_TimesEquals(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_DividedEquals(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_ExponentEquals(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_Negation(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+ScriptToken* Eval_LogicalNot(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
+
+// an entry of the RPN stack while compiling
+struct CompiledExpression::Operand
+{
+	enum Kind : UInt8
+	{
+		kRegister,	// index is a register
+		kVar,		// index into varTokens_, read when the consuming operator runs like ScriptToken::GetNumber() would
+		kGlobal,	// index into globals_
+	};
+
+	Kind		kind;
+	Token_Type	type;
+	UInt8		varType;
+	UInt16		index;
+};
+
+namespace
+{
+	struct PendingJump
+	{
+		UInt32 instruction;
+		UInt32 targetToken;
+		UInt32 depth;	// RPN stack size at the target
+	};
+
+	constexpr UInt32 kJumpLanded = 0xFFFFFFFF;
+
+	// same messages as the operator routines and ExpressionEvaluator::Evaluate()
+	bool DivisionByZero(CachedTokens& tokens, ExpressionEvaluator& context, UInt16 tokenIdx, UInt32& faultingToken)
+	{
+		context.Error("Division by zero");
+		context.Error("Operator %s failed to evaluate to a valid result", tokens.Get(tokenIdx).token.GetOperator()->symbol);
+		faultingToken = tokenIdx;
+		return false;
+	}
+}
+
+UInt16 CompiledExpression::LoadOperand(const Operand& operand, UInt16 slot, UInt32 tokenIdx)
+{
+	switch (operand.kind)
+	{
+	case Operand::kVar:
+		code_.push_back(Instruction{Op::LoadVar, false, slot, operand.index, 0, static_cast<UInt16>(tokenIdx)});
+		return slot;
+	case Operand::kGlobal:
+		code_.push_back(Instruction{Op::LoadGlobal, false, slot, operand.index, 0, static_cast<UInt16>(tokenIdx)});
+		return slot;
+	default:
+		return operand.index;
+	}
+}
+
+bool CompiledExpression::CompileOperator(const Operator* op, UInt32 tokenIdx, std::vector<Operand>& stack, UInt32 firstSlot)
+{
+	if (op->numOperands == 0 || op->numOperands > 2 || stack.size() < op->numOperands)
+		return false;
+
+	Operand lhs{}, rhs{};
+	if (op->numOperands == 2)
+	{
+		rhs = stack.back();
+		stack.pop_back();
+	}
+	lhs = stack.back();
+	stack.pop_back();
+
+	// operands are loaded to the RPN stack slots they were pushed to, the result goes to the lower one
+	const auto dstSlot = static_cast<UInt16>(firstSlot + stack.size());
+	auto lhsSlot = dstSlot;
+	auto rhsSlot = static_cast<UInt16>(dstSlot + 1);
+
+	// pick the rule Operator::Evaluate would pick at run time, operand types are exact here
+	bool swapOrder;
+	const OperationRule* rule = op->MatchRule(lhs.type, rhs.type, swapOrder);
+	if (!rule || (rule->result != kTokenType_Number && rule->result != kTokenType_Boolean))
+		return false;
+	if (swapOrder)
+	{
+		std::swap(lhs, rhs);
+		std::swap(lhsSlot, rhsSlot);
+	}
+
+	Op code;
+	bool assigns = false;
+	const auto eval = rule->eval;
+	if (eval == Eval_Add_Number)
+		code = Op::Add;
+	else if (eval == Eval_Arithmetic)
+	{
+		switch (op->type)
+		{
+		case kOpType_Subtract:	code = Op::Subtract; break;
+		case kOpType_Multiply:	code = Op::Multiply; break;
+		case kOpType_Divide:	code = Op::Divide; break;
+		case kOpType_Exponent:	code = Op::Exponent; break;
+		default: return false;
+		}
+	}
+	else if (eval == Eval_Integer)
+	{
+		switch (op->type)
+		{
+		case kOpType_Modulo:		code = Op::Modulo; break;
+		case kOpType_BitwiseOr:		code = Op::BitwiseOr; break;
+		case kOpType_BitwiseAnd:	code = Op::BitwiseAnd; break;
+		case kOpType_LeftShift:		code = Op::LeftShift; break;
+		case kOpType_RightShift:	code = Op::RightShift; break;
+		default: return false;
+		}
+	}
+	else if (eval == Eval_Comp_Number_Number)
+	{
+		switch (op->type)
+		{
+		case kOpType_GreaterThan:		code = Op::GreaterThan; break;
+		case kOpType_LessThan:			code = Op::LessThan; break;
+		case kOpType_GreaterOrEqual:	code = Op::GreaterOrEqual; break;
+		case kOpType_LessOrEqual:		code = Op::LessOrEqual; break;
+		default: return false;
+		}
+	}
+	else if (eval == Eval_Eq_Number)
+	{
+		if (op->type != kOpType_Equals && op->type != kOpType_NotEqual)
+			return false;
+		code = op->type == kOpType_Equals ? Op::Equals : Op::NotEqual;
+	}
+	else if (eval == Eval_Logical)
+	{
+		if (op->type != kOpType_LogicalAnd && op->type != kOpType_LogicalOr)
+			return false;
+		code = op->type == kOpType_LogicalAnd ? Op::LogicalAnd : Op::LogicalOr;
+	}
+	else if (eval == Eval_Negation)
+		code = Op::Negation;
+	else if (eval == Eval_LogicalNot)
+		code = Op::LogicalNot;
+	else
+	{
+		assigns = true;
+		if (eval == Eval_Assign_Numeric)
+			code = Op::Assign;
+		else if (eval == Eval_PlusEquals_Number)
+			code = Op::PlusEquals;
+		else if (eval == Eval_MinusEquals_Number)
+			code = Op::MinusEquals;
+		else if (eval == Eval_TimesEquals)
+			code = Op::TimesEquals;
+		else if (eval == Eval_DividedEquals)
+			code = Op::DividedEquals;
+		else if (eval == Eval_ExponentEquals)
+			code = Op::ExponentEquals;
+		else
+			return false;
+	}
+
+	Instruction instruction{code, false, dstSlot, 0, 0, static_cast<UInt16>(tokenIdx)};
+	if (assigns)
+	{
+		if (lhs.kind != Operand::kVar)
+			return false;
+		instruction.integer = code == Op::Assign && lhs.varType == Script::eVarType_Integer;
+		instruction.a = lhs.index;
+		instruction.b = LoadOperand(rhs, rhsSlot, tokenIdx);
+	}
+	else
+	{
+		instruction.a = LoadOperand(lhs, lhsSlot, tokenIdx);
+		if (op->numOperands == 2)
+			instruction.b = LoadOperand(rhs, rhsSlot, tokenIdx);
+	}
+	code_.push_back(instruction);
+	stack.push_back(Operand{Operand::kRegister, rule->result, Script::eVarType_Invalid, dstSlot});
+	return true;
+}
+
+CompiledExpression* CompiledExpression::Compile(CachedTokens& tokens)
+{
+	const UInt32 numTokens = tokens.Size();
+	if (numTokens < 2 || numTokens > 0xFFFF)
+		return nullptr;
+
+	std::unique_ptr<CompiledExpression> expr(new CompiledExpression());
+
+	// literals get fixed registers, the RPN stack slots follow them
+	std::vector<UInt16> literalRegisters(numTokens, 0);
+	for (UInt32 i = 0; i < numTokens; i++)
+	{
+		const auto& token = tokens.Get(i).token;
+		if (token.Type() == kTokenType_Number || token.Type() == kTokenType_Boolean)
+		{
+			literalRegisters[i] = static_cast<UInt16>(expr->registers_.size());
+			expr->registers_.push_back(token.value.num);
+		}
+	}
+	const UInt32 firstSlot = expr->registers_.size();
+
+	std::vector<Operand> stack;
+	std::vector<PendingJump> jumps;
+	UInt32 maxDepth = 0;
+	for (UInt32 i = 0; i < numTokens; i++)
+	{
+		for (auto& jump : jumps)
+		{
+			if (jump.targetToken != i)
+				continue;
+			// the skipped operator chain must leave its boolean result in the slot the jump writes to
+			if (stack.size() != jump.depth || stack.back().kind != Operand::kRegister || stack.back().index != firstSlot + jump.depth - 1)
+				return nullptr;
+			expr->code_[jump.instruction].b = static_cast<UInt16>(expr->code_.size());
+			jump.targetToken = kJumpLanded;
+		}
+
+		auto& token = tokens.Get(i).token;
+		switch (token.Type())
+		{
+		case kTokenType_Number:
+			stack.push_back(Operand{Operand::kRegister, kTokenType_Number, Script::eVarType_Invalid, literalRegisters[i]});
+			break;
+		case kTokenType_Boolean:	// folded comparison
+			stack.push_back(Operand{Operand::kRegister, kTokenType_Boolean, Script::eVarType_Invalid, literalRegisters[i]});
+			break;
+		case kTokenType_NumericVar:
+			stack.push_back(Operand{Operand::kVar, kTokenType_NumericVar, token.variableType, static_cast<UInt16>(expr->varTokens_.size())});
+			expr->varTokens_.push_back(static_cast<UInt16>(i));
+			break;
+		case kTokenType_Global:
+			if (!token.GetGlobal())
+				return nullptr;
+			stack.push_back(Operand{Operand::kGlobal, kTokenType_Global, Script::eVarType_Invalid, static_cast<UInt16>(expr->globals_.size())});
+			expr->globals_.push_back(token.GetGlobal());
+			break;
+		case kTokenType_Operator:
+			if (!expr->CompileOperator(token.GetOperator(), i, stack, firstSlot))
+				return nullptr;
+			break;
+		default:
+			return nullptr;
+		}
+		maxDepth = std::max<UInt32>(maxDepth, stack.size());
+
+		// see ShortCircuit() in ScriptUtils.cpp
+		if (token.shortCircuitParentType != kOpType_Max)
+		{
+			const auto& top = stack.back();
+			if (top.kind != Operand::kRegister || top.type != kTokenType_Boolean || token.shortCircuitStackOffset > stack.size())
+				return nullptr;
+			const UInt32 depth = stack.size() - token.shortCircuitStackOffset + 1;
+			const auto op = token.shortCircuitParentType == kOpType_LogicalAnd ? Op::JumpIfFalse : Op::JumpIfTrue;
+			jumps.push_back(PendingJump{expr->code_.size(), i + token.shortCircuitDistance + 1, depth});
+			expr->code_.push_back(Instruction{op, false, static_cast<UInt16>(firstSlot + depth - 1), top.index, 0, static_cast<UInt16>(i)});
+		}
+	}
+
+	if (stack.size() != 1 || stack.back().kind != Operand::kRegister || stack.back().index < firstSlot)
+		return nullptr;
+	for (auto& jump : jumps)
+	{
+		if (jump.targetToken == kJumpLanded)
+			continue;
+		if (jump.targetToken != numTokens || jump.depth != 1)
+			return nullptr;
+		expr->code_[jump.instruction].b = static_cast<UInt16>(expr->code_.size());
+	}
+
+	expr->result_ = stack.back().index;
+	expr->resultIsBool_ = stack.back().type == kTokenType_Boolean;
+	expr->registers_.resize(firstSlot + maxDepth, 0);
+	return expr.release();
+}
+
+// running an expression never runs another one, so one buffer per thread is enough
+thread_local std::vector<double> t_registers;
+thread_local std::vector<ScriptEventList::Var*> t_vars;
+
+ScriptToken* CompiledExpression::Execute(CachedTokens& tokens, TokenEvalState& state, ExpressionEvaluator& context, UInt32& faultingToken) const
+{
+	double result;
+	if (!Execute(tokens, state, context, faultingToken, result))
+		return nullptr;
+	if (resultIsBool_)
+		return ScriptToken::Create(result != 0);
+	return ScriptToken::Create(result);
+}
+
+bool CompiledExpression::Execute(CachedTokens& tokens, TokenEvalState& state, ExpressionEvaluator& context, UInt32& faultingToken, double& result) const
+{
+	if (t_vars.size() < varTokens_.size())
+		t_vars.resize(varTokens_.size());
+	auto* vars = t_vars.data();
+	for (UInt32 i = 0; i < varTokens_.size(); i++)
+	{
+		const auto stateIdx = tokens.Get(varTokens_[i]).stateIdx;
+		auto& token = state.vars[stateIdx];
+		token.context = &context;
+		if (!token.ResolveVariable(state.varCaches[stateIdx]))
+		{
+			context.Error("Failed to resolve variable");
+			faultingToken = varTokens_[i];
+			return false;
+		}
+		vars[i] = token.GetVar();
+	}
+
+	if (t_registers.size() < registers_.size())
+		t_registers.resize(registers_.size());
+	double* r = t_registers.data();
+	memcpy(r, registers_.data(), registers_.size() * sizeof(double));
+	const auto* code = code_.data();
+	const UInt32 numInstructions = code_.size();
+	UInt32 pc = 0;
+	while (pc < numInstructions)
+	{
+		const auto& in = code[pc++];
+		switch (in.op)
+		{
+		case Op::LoadVar:			r[in.dst] = vars[in.a]->data; break;
+		case Op::LoadGlobal:		r[in.dst] = globals_[in.a]->data; break;
+		case Op::Add:				r[in.dst] = r[in.a] + r[in.b]; break;
+		case Op::Subtract:			r[in.dst] = r[in.a] - r[in.b]; break;
+		case Op::Multiply:			r[in.dst] = r[in.a] * r[in.b]; break;
+		case Op::Divide:
+			if (r[in.b] == 0)
+				return DivisionByZero(tokens, context, in.token, faultingToken);
+			r[in.dst] = r[in.a] / r[in.b];
+			break;
+		case Op::Exponent:			r[in.dst] = pow(r[in.a], r[in.b]); break;
+		case Op::Modulo:
+		{
+			const SInt64 l = r[in.a], rh = r[in.b];
+			if (rh == 0)
+				return DivisionByZero(tokens, context, in.token, faultingToken);
+			r[in.dst] = double(l % rh);
+			break;
+		}
+		case Op::BitwiseOr:			r[in.dst] = double(SInt64(r[in.a]) | SInt64(r[in.b])); break;
+		case Op::BitwiseAnd:		r[in.dst] = double(SInt64(r[in.a]) & SInt64(r[in.b])); break;
+		case Op::LeftShift:			r[in.dst] = double(SInt64(r[in.a]) << SInt64(r[in.b])); break;
+		case Op::RightShift:		r[in.dst] = double(SInt64(r[in.a]) >> SInt64(r[in.b])); break;
+		case Op::GreaterThan:		r[in.dst] = r[in.a] > r[in.b]; break;
+		case Op::LessThan:			r[in.dst] = r[in.a] < r[in.b]; break;
+		case Op::GreaterOrEqual:	r[in.dst] = r[in.a] >= r[in.b]; break;
+		case Op::LessOrEqual:		r[in.dst] = r[in.a] <= r[in.b]; break;
+		case Op::Equals:			r[in.dst] = FloatEqual(r[in.a], r[in.b]); break;
+		case Op::NotEqual:			r[in.dst] = !FloatEqual(r[in.a], r[in.b]); break;
+		case Op::LogicalAnd:		r[in.dst] = r[in.a] != 0 && r[in.b] != 0; break;
+		case Op::LogicalOr:			r[in.dst] = r[in.a] != 0 || r[in.b] != 0; break;
+		case Op::Negation:			r[in.dst] = -r[in.a]; break;
+		case Op::LogicalNot:		r[in.dst] = r[in.a] == 0; break;
+		case Op::Assign:
+		{
+			const double value = in.integer ? floor(r[in.b]) : r[in.b];
+			vars[in.a]->data = value;
+			r[in.dst] = value;
+			break;
+		}
+		case Op::PlusEquals:		r[in.dst] = vars[in.a]->data += r[in.b]; break;
+		case Op::MinusEquals:		r[in.dst] = vars[in.a]->data -= r[in.b]; break;
+		case Op::TimesEquals:		r[in.dst] = vars[in.a]->data *= r[in.b]; break;
+		case Op::DividedEquals:
+			if (r[in.b] == 0.0)
+				return DivisionByZero(tokens, context, in.token, faultingToken);
+			r[in.dst] = vars[in.a]->data /= r[in.b];
+			break;
+		case Op::ExponentEquals:	r[in.dst] = vars[in.a]->data = pow(vars[in.a]->data, r[in.b]); break;
+		case Op::JumpIfFalse:
+			if (r[in.a] == 0)
+			{
+				r[in.dst] = r[in.a];
+				pc = in.b;
+			}
+			break;
+		case Op::JumpIfTrue:
+			if (r[in.a] != 0)
+			{
+				r[in.dst] = r[in.a];
+				pc = in.b;
+			}
+			break;
+		}
+	}
+
+	result = r[result_];
+	return true;
+}
+
+#endif
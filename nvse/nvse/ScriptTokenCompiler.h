@@ -0,0 +1,62 @@
+#pragma once
+#if RUNTIME
+#include <vector>
+
+#include "ScriptTokens.h"
+
+class CachedTokens;
+struct TokenEvalState;
+
+// Second compilation stage for cached expressions that only work on numbers. The RPN token sequence is
+// lowered to three-address code over a register file allocated once per expression: one register per
+// numeric literal followed by one per RPN stack slot. Running such an expression allocates nothing but
+// the token that holds its result. Compiled expressions are shared between threads and not modified by
+// running them, the register file is copied to a per thread buffer first. Expressions using anything else (commands, strings, forms, arrays,
+// short-circuited operands that aren't booleans) are not compiled and stay on the RPN interpreter.
+class CompiledExpression
+{
+	enum class Op : UInt8
+	{
+		LoadVar,		// dst = vars[a]
+		LoadGlobal,		// dst = globals[a]
+		Add, Subtract, Multiply, Divide, Exponent,
+		Modulo, BitwiseOr, BitwiseAnd, LeftShift, RightShift,
+		GreaterThan, LessThan, GreaterOrEqual, LessOrEqual, Equals, NotEqual,
+		LogicalAnd, LogicalOr, Negation, LogicalNot,
+		Assign, PlusEquals, MinusEquals, TimesEquals, DividedEquals, ExponentEquals,	// vars[a] op= b, dst = vars[a]
+		JumpIfFalse, JumpIfTrue,	// short circuit: if a, dst = a and continue at instruction b
+	};
+
+	struct Instruction
+	{
+		Op		op;
+		bool	integer;	// assignment to an integer variable
+		UInt16	dst;
+		UInt16	a;
+		UInt16	b;
+		UInt16	token;		// index of the token compiled into this instruction, for error reporting
+	};
+
+	std::vector<Instruction>			code_;
+	std::vector<double>					registers_;	// initial register file
+	std::vector<UInt16>					varTokens_;	// cache indices of variable operands, resolved before each run
+	std::vector<TESGlobal*>				globals_;
+	UInt16								result_ = 0;
+	bool								resultIsBool_ = false;
+
+	struct Operand;
+	bool CompileOperator(const Operator* op, UInt32 tokenIdx, std::vector<Operand>& stack, UInt32 firstSlot);
+	UInt16 LoadOperand(const Operand& operand, UInt16 slot, UInt32 tokenIdx);
+
+public:
+	// returns nullptr if the expression uses anything the register machine doesn't handle
+	static CompiledExpression* Compile(CachedTokens& tokens);
+
+	// returns nullptr on failure, with the index of the token that failed in faultingToken
+	ScriptToken* Execute(CachedTokens& tokens, TokenEvalState& state, ExpressionEvaluator& context, UInt32& faultingToken) const;
+
+	// same without creating a token for the result
+	bool Execute(CachedTokens& tokens, TokenEvalState& state, ExpressionEvaluator& context, UInt32& faultingToken, double& result) const;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "ScriptTokens.h"
 #include "ScriptUtils.h"
+#include "ScriptTokenCache.h"
 #include "GameRTTI.h"
 #include "SmallObjectsAllocator.h"
 #include "GameObjects.h"
@@ -17,11 +18,8 @@ ScriptToken::~ScriptToken()
 #ifdef DBG_EXPR_LEAKS
 	TOKEN_COUNT--;
 #endif
-	if ((type == kTokenType_String) && value.str)
-	{
-		free(value.str);
-		value.str = NULL;
-	}
+	if (type == kTokenType_String)
+		ReleaseString();
 }
 
 /*************************************
@@ -63,13 +61,13 @@ ScriptToken::ScriptToken(Script::RefVariable* refVar, UInt16 refIdx) : type(kTok
 ScriptToken::ScriptToken(const std::string& str) : type(kTokenType_String), refIdx(0), variableType(Script::eVarType_Invalid)
 {
 	INC_TOKEN_COUNT
-	value.str = str.empty() ? NULL : CopyString(str.c_str());
+	InitString(str.c_str(), str.size());
 }
 
 ScriptToken::ScriptToken(const char* str) : type(kTokenType_String), refIdx(0), variableType(Script::eVarType_Invalid)
 {
 	INC_TOKEN_COUNT
-	value.str = (str && *str) ? CopyString(str) : NULL;
+	InitString(str, StrLen(str));
 }
 
 ScriptToken::ScriptToken(TESGlobal* global, UInt16 refIdx) : type(kTokenType_Global), refIdx(refIdx), variableType(Script::eVarType_Invalid)
@@ -159,7 +157,7 @@ ScriptToken::ScriptToken(const ScriptToken &from)
 	shortCircuitStackOffset = from.shortCircuitStackOffset;
 #endif
 	if (type == kTokenType_String)
-		value.str = from.value.str ? CopyString(from.value.str) : NULL;
+		ShareString(from);
 	else value = from.value;
 }
 
@@ -342,31 +340,68 @@ ScriptToken* ScriptToken::Create(ArrayElementToken* elem, UInt32 lbound, UInt32
 }
 
 thread_local SmallObjectsAllocator::FastAllocator<ScriptToken, 32> g_scriptTokenAllocator;
+thread_local SmallObjectsAllocator::ArenaAllocator<ScriptToken, 64> g_scriptTokenArena;
+thread_local UInt32 g_scriptTokenArenaDepth = 0;
+thread_local bool g_allocateTokensInArena = false;
 
 void* ScriptToken::operator new(size_t size)
 {
 	//return ::operator new(size);
+	if (g_allocateTokensInArena)
+		return g_scriptTokenArena.Allocate();
 	return g_scriptTokenAllocator.Allocate();
 }
 
 void ScriptToken::operator delete(void* p)
 {
 	//::operator delete(p);
+	if (g_scriptTokenArena.Owns(p))
+		return;
 	g_scriptTokenAllocator.Free(p);
 }
 
+ScriptTokenArena::Frame::Frame() : allocating_(g_allocateTokensInArena)
+{
+	// commands run by this call may keep the tokens they create
+	g_allocateTokensInArena = false;
+	++g_scriptTokenArenaDepth;
+}
+
+ScriptTokenArena::Frame::~Frame()
+{
+	g_allocateTokensInArena = allocating_;
+	if (!--g_scriptTokenArenaDepth)
+		g_scriptTokenArena.Reset();
+}
+
+ScriptTokenArena::Scope::Scope(bool enable) : previous_(g_allocateTokensInArena)
+{
+	g_allocateTokensInArena = enable;
+}
+
+ScriptTokenArena::Scope::~Scope()
+{
+	g_allocateTokensInArena = previous_;
+}
+
+ScriptToken* ScriptTokenArena::Promote(ScriptToken* token)
+{
+	if (!token || !g_scriptTokenArena.Owns(token))
+		return token;
+	ScriptToken* pooled = new ScriptToken(*token);
+	delete token;
+	return pooled;
+}
+
 ScriptToken& ScriptToken::operator=(const ScriptToken& rhs)
 {
 	if (this != &rhs)
 	{
-		if ((type == kTokenType_String) && value.str)
-			free(value.str);
+		if (type == kTokenType_String)
+			ReleaseString();
 		memcpy(this, &rhs, sizeof(ScriptToken));
-		if ((type == kTokenType_String) && value.str)
-		{
-			char *strCopy = CopyString(value.str);
-			value.str = strCopy;
-		}
+		if (type == kTokenType_String)
+			ShareString(rhs);
 	}
 	return *this;
 }
@@ -504,12 +539,92 @@ Slice::Slice(const Slice* _slice)
 void ScriptToken::SetString(const char *srcStr)
 {
 	if (type == kTokenType_String)
+		ReleaseString();
+	else type = kTokenType_String;
+	InitString(srcStr, StrLen(srcStr));
+}
+
+namespace
+{
+	struct SharedTokenString
 	{
-		if (value.str)
-			free(value.str);
+		volatile LONG	refCount;
+		char			data[1];
+
+		static SharedTokenString* FromData(char* data)
+		{
+			return reinterpret_cast<SharedTokenString*>(data - offsetof(SharedTokenString, data));
+		}
+	};
+}
+
+char* ScriptToken::InitString(UInt32 length)
+{
+	strLength = length;
+	if (IsInlineString())
+	{
+		value.str = NULL;
+		inlineStr[length] = 0;
+		return inlineStr;
 	}
-	else type = kTokenType_String;
-	value.str = (srcStr && *srcStr) ? CopyString(srcStr) : NULL;
+	auto* shared = static_cast<SharedTokenString*>(malloc(offsetof(SharedTokenString, data) + length + 1));
+	shared->refCount = 1;
+	value.str = shared->data;
+	value.str[length] = 0;
+	return value.str;
+}
+
+void ScriptToken::InitString(const char* str, UInt32 length)
+{
+	if (!length)
+	{
+		strLength = 0;
+		value.str = NULL;
+		return;
+	}
+	memcpy(InitString(length), str, length);
+}
+
+void ScriptToken::ShareString(const ScriptToken& from)
+{
+	strLength = from.strLength;
+	if (!strLength)
+		value.str = NULL;
+	else if (IsInlineString())
+	{
+		memcpy(inlineStr, from.inlineStr, strLength + 1);
+		value.str = NULL;
+	}
+	else
+	{
+		InterlockedIncrement(&SharedTokenString::FromData(from.value.str)->refCount);
+		value.str = from.value.str;
+	}
+}
+
+void ScriptToken::ReleaseString()
+{
+	if (!IsInlineString() && value.str)
+	{
+		auto* shared = SharedTokenString::FromData(value.str);
+		if (!InterlockedDecrement(&shared->refCount))
+			free(shared);
+	}
+	value.str = NULL;
+	strLength = 0;
+}
+
+ScriptToken* ScriptToken::CreateConcat(const char* lStr, const char* rStr)
+{
+	const UInt32 lLen = StrLen(lStr), rLen = StrLen(rStr);
+	ScriptToken* token = Create((const char*)NULL);
+	if (lLen || rLen)
+	{
+		char* conStr = token->InitString(lLen + rLen);
+		memcpy(conStr, lStr, lLen);
+		memcpy(conStr + lLen, rStr, rLen);
+	}
+	return token;
 }
 
 #if RUNTIME
@@ -576,7 +691,7 @@ const char* ScriptToken::GetString()
 	const char* result = NULL;
 
 	if (type == kTokenType_String)
-		result = value.str;
+		result = StringData();
 #if RUNTIME
 	else if (type == kTokenType_StringVar)
 	{
@@ -717,9 +832,8 @@ ScriptEventList::Var* ScriptToken::GetVar() const
 	return value.var;
 }
 
-bool ScriptToken::ResolveVariable()
+ScriptEventList* ScriptToken::GetVariableEventList() const
 {
-	value.var = nullptr;
 	auto* scriptEventList = context->eventList;
 	if (refIdx)
 	{
@@ -731,12 +845,37 @@ bool ScriptToken::ResolveVariable()
 				scriptEventList = EventListFromForm(refVar->form);
 		}
 	}
+	return scriptEventList;
+}
+
+bool ScriptToken::ResolveVariable()
+{
+	value.var = nullptr;
+	auto* scriptEventList = GetVariableEventList();
 	if (scriptEventList)
 		value.var = scriptEventList->GetVariable(varIdx);
 	if (!value.var)
 		return false;
 	return true;
 }
+
+bool ScriptToken::ResolveVariable(VarCache& cache)
+{
+	auto* scriptEventList = GetVariableEventList();
+	if (!scriptEventList)
+	{
+		value.var = nullptr;
+		return false;
+	}
+	value.var = cache.Get(scriptEventList);
+	if (value.var)
+		return true;
+	value.var = scriptEventList->GetVariable(varIdx);
+	if (!value.var)
+		return false;
+	cache.Set(scriptEventList, value.var);
+	return true;
+}
 #endif
 
 TESGlobal* ScriptToken::GetGlobal() const
@@ -905,109 +1044,37 @@ Token_Type ScriptToken::ReadFrom(ExpressionEvaluator* context)
 	{
 		type = kTokenType_String;
 		UInt32 incData = 0;
-		value.str = context->ReadString(incData);
+		char* str = context->ReadString(incData);
+		InitString(str, incData - 2);
+		free(str);
 		break;
 	}
 	case 'R':
-		type = kTokenType_Ref;
-		refIdx = context->Read16();
-		value.refVar = context->script->GetRefFromRefList(refIdx);
-		if (!value.refVar)
-			type = kTokenType_Invalid;
-		else
-		{
-			type = kTokenType_Form;
-			value.refVar->Resolve(context->eventList);
-			value.formID = value.refVar->form ? value.refVar->form->refID : 0;
-		}
+	{
 		//incrementData = 3;
-		break;
+		const auto refIdx = context->Read16();
+		return InitRef(context, refIdx);
+	}
 	case 'G':
 	{
-		type = kTokenType_Global;
-		refIdx = context->Read16();
-		Script::RefVariable* refVar = context->script->GetRefFromRefList(refIdx);
-		if (!refVar)
-		{
-			type = kTokenType_Invalid;
-			break;
-		}
-		refVar->Resolve(context->eventList);
-		value.global = DYNAMIC_CAST(refVar->form, TESForm, TESGlobal);
-		if (!value.global)
-			type = kTokenType_Invalid;
-
-		break;
+		const auto refIdx = context->Read16();
+		return InitGlobal(context, refIdx);
 	}
 	case 'X':
 	{
-		type = kTokenType_Command;
-		refIdx = context->Read16();
+		const auto refIdx = context->Read16();
 		const auto opcode = context->Read16();
-		value.cmd = g_scriptCommands.GetByOpcode(opcode);
-		if (!value.cmd)
-			type = kTokenType_Invalid;
 		auto argsLen = context->Read16();
-		cmdOpcodeOffset = context->m_data - context->m_scriptData;
+		InitCommand(refIdx, opcode, context->m_data - context->m_scriptData);
 		context->m_data += argsLen - 2;
-		returnType = g_scriptCommands.GetReturnType(value.cmd);
 		break;
 	}
 	case 'V':
 	{
-		variableType = context->ReadByte();
-		switch (variableType)
-		{
-		case Script::eVarType_Array:
-			type = kTokenType_ArrayVar;
-			break;
-		case Script::eVarType_Integer:
-		case Script::eVarType_Float:
-			type = kTokenType_NumericVar;
-			break;
-		case Script::eVarType_Ref:
-			type = kTokenType_RefVar;
-			break;
-		case Script::eVarType_String:
-			type = kTokenType_StringVar;
-			break;
-		default:
-			type = kTokenType_Invalid;
-		}
-
-		refIdx = context->Read16();
-
-		ScriptEventList* eventList = context->eventList;
-		if (refIdx)
-		{
-			Script::RefVariable* refVar = context->script->GetRefFromRefList(refIdx);
-			if (refVar)
-			{
-				refVar->Resolve(context->eventList);
-				if (refVar->form)
-					eventList = EventListFromForm(refVar->form);
-			}
-		}
-
-		varIdx = context->Read16();
-		value.var = NULL;
-		if (eventList)
-			value.var = eventList->GetVariable(varIdx);
-
-		if (!value.var)
-			type = kTokenType_Invalid;
-#if _DEBUG
-		if (value.var && !refIdx)
-		{
-			this->varName = context->script->GetVariableInfo(varIdx)->name.CStr();
-		}
-#endif
-
-		// to be deleted on event list destruction, see Hooks_Other.cpp#CleanUpNVSEVars
-		if (type == kTokenType_ArrayVar || type == kTokenType_StringVar && refIdx == 0)
-			g_nvseVarGarbageCollectionMap[eventList].Emplace(varIdx, type == kTokenType_StringVar ? NVSEVarType::kVarType_String : NVSEVarType::kVarType_Array);
-		
-		break;
+		const auto varType = context->ReadByte();
+		const auto refIdx = context->Read16();
+		const auto varIdx = context->Read16();
+		return InitVariable(context, varType, refIdx, varIdx);
 	}
 	default:
 	{
@@ -1027,6 +1094,107 @@ Token_Type ScriptToken::ReadFrom(ExpressionEvaluator* context)
 	return type;
 }
 
+Token_Type ScriptToken::InitRef(ExpressionEvaluator* context, UInt16 _refIdx)
+{
+	type = kTokenType_Ref;
+	refIdx = _refIdx;
+	value.refVar = context->script->GetRefFromRefList(refIdx);
+	if (!value.refVar)
+		type = kTokenType_Invalid;
+	else
+	{
+		type = kTokenType_Form;
+		value.refVar->Resolve(context->eventList);
+		value.formID = value.refVar->form ? value.refVar->form->refID : 0;
+	}
+	return type;
+}
+
+Token_Type ScriptToken::InitGlobal(ExpressionEvaluator* context, UInt16 _refIdx)
+{
+	type = kTokenType_Global;
+	refIdx = _refIdx;
+	Script::RefVariable* refVar = context->script->GetRefFromRefList(refIdx);
+	if (!refVar)
+	{
+		type = kTokenType_Invalid;
+		return type;
+	}
+	refVar->Resolve(context->eventList);
+	value.global = DYNAMIC_CAST(refVar->form, TESForm, TESGlobal);
+	if (!value.global)
+		type = kTokenType_Invalid;
+	return type;
+}
+
+Token_Type ScriptToken::InitCommand(UInt16 _refIdx, UInt16 opcode, UInt32 _cmdOpcodeOffset)
+{
+	type = kTokenType_Command;
+	refIdx = _refIdx;
+	value.cmd = g_scriptCommands.GetByOpcode(opcode);
+	if (!value.cmd)
+		type = kTokenType_Invalid;
+	cmdOpcodeOffset = _cmdOpcodeOffset;
+	returnType = g_scriptCommands.GetReturnType(value.cmd);
+	return type;
+}
+
+Token_Type ScriptToken::InitVariable(ExpressionEvaluator* context, UInt8 varType, UInt16 _refIdx, UInt16 _varIdx)
+{
+	variableType = varType;
+	switch (variableType)
+	{
+	case Script::eVarType_Array:
+		type = kTokenType_ArrayVar;
+		break;
+	case Script::eVarType_Integer:
+	case Script::eVarType_Float:
+		type = kTokenType_NumericVar;
+		break;
+	case Script::eVarType_Ref:
+		type = kTokenType_RefVar;
+		break;
+	case Script::eVarType_String:
+		type = kTokenType_StringVar;
+		break;
+	default:
+		type = kTokenType_Invalid;
+	}
+
+	refIdx = _refIdx;
+
+	ScriptEventList* eventList = context->eventList;
+	if (refIdx)
+	{
+		Script::RefVariable* refVar = context->script->GetRefFromRefList(refIdx);
+		if (refVar)
+		{
+			refVar->Resolve(context->eventList);
+			if (refVar->form)
+				eventList = EventListFromForm(refVar->form);
+		}
+	}
+
+	varIdx = _varIdx;
+	value.var = NULL;
+	if (eventList)
+		value.var = eventList->GetVariable(varIdx);
+
+	if (!value.var)
+		type = kTokenType_Invalid;
+#if _DEBUG
+	if (value.var && !refIdx)
+	{
+		this->varName = context->script->GetVariableInfo(varIdx)->name.CStr();
+	}
+#endif
+
+	// to be deleted on event list destruction, see Hooks_Other.cpp#CleanUpNVSEVars
+	if (type == kTokenType_ArrayVar || type == kTokenType_StringVar && refIdx == 0)
+		g_nvseVarGarbageCollectionMap[eventList].Emplace(varIdx, type == kTokenType_StringVar ? NVSEVarType::kVarType_String : NVSEVarType::kVarType_Array);
+	return type;
+}
+
 #endif
 
 // compiling typecodes to printable chars just makes verifying parser output much easier
@@ -1075,7 +1243,7 @@ bool ScriptToken::Write(ScriptLineBuffer* buf)
 			}
 		}
 	case kTokenType_String:
-		return buf->WriteString(value.str);
+		return buf->WriteString(StringData());
 	case kTokenType_Ref:
 	case kTokenType_Global:
 		return buf->Write16(refIdx);
@@ -1186,6 +1354,27 @@ bool ArrayElementToken::CanConvertTo(Token_Type to) const
 	return false;
 }
 
+UInt8 ArrayElementToken::GetOperandKind() const
+{
+	if (!IsGood())
+		return kOperandKind_BadElement;
+
+	ArrayVar *arr = g_ArrayMap.Get(GetOwningArrayID());
+	switch (arr ? arr->GetElementType(&key) : kDataType_Invalid)
+	{
+	case kDataType_Numeric:
+		return kOperandKind_NumericElement;
+	case kDataType_Form:
+		return kOperandKind_FormElement;
+	case kDataType_String:
+		return kOperandKind_StringElement;
+	case kDataType_Array:
+		return kOperandKind_ArrayElement;
+	default:
+		return kOperandKind_MissingElement;
+	}
+}
+
 thread_local SmallObjectsAllocator::FastAllocator<ArrayElementToken, 4> g_arrayTokenAllocator;
 
 void* ArrayElementToken::operator new(size_t size)
@@ -1235,13 +1424,12 @@ bool ArrayElementToken::GetBool()
 	ArrayVar *arr = g_ArrayMap.Get(GetOwningArrayID());
 	if (!arr) return false;
 
-	ArrayElement *elem = arr->Get(&key, false);
-	if (!elem) return false;
-
-	if (elem->DataType() == kDataType_Numeric)
-		return elem->m_data.num != 0;
-	else if (elem->DataType() == kDataType_Form)
-		return elem->m_data.formID != 0;
+	double num;
+	if (arr->GetElementNumber(&key, &num))
+		return num != 0;
+	UInt32 formID;
+	if (arr->GetElementFormID(&key, &formID))
+		return formID != 0;
 
 	return false;
 }
@@ -1418,6 +1606,30 @@ Token_Type Operator::GetResult(Token_Type lhs, Token_Type rhs)
 	return kTokenType_Invalid;
 }
 
+const OperationRule* Operator::MatchRule(Token_Type lhs, Token_Type rhs, bool& swapOrder) const
+{
+	swapOrder = false;
+	for (UInt32 i = 0; i < numRules; i++)
+	{
+		const OperationRule* rule = &rules[i];
+		if (!rule->eval)
+			continue;
+		if (numOperands == 1)
+		{
+			if (CanConvertOperand(lhs, rule->lhs))
+				return rule;
+		}
+		else if (CanConvertOperand(lhs, rule->lhs) && CanConvertOperand(rhs, rule->rhs))
+			return rule;
+		else if (!rule->bAsymmetric && CanConvertOperand(rhs, rule->lhs) && CanConvertOperand(lhs, rule->rhs))
+		{
+			swapOrder = true;
+			return rule;
+		}
+	}
+	return nullptr;
+}
+
 #if RUNTIME
 
 void Slice::GetArrayBounds(ArrayKey& lo, ArrayKey& hi) const
@@ -1443,7 +1655,7 @@ char* ScriptToken::DebugPrint() const
 	switch (type) {
 		case kTokenType_Number: sprintf_s(debugPrint, 512, "[Type=Number, Value=%g]", value.num); break;
 		case kTokenType_Boolean: sprintf_s(debugPrint, 512, "[Type=Boolean, Value=%s]", value.num ? "true" : "false"); break;
-		case kTokenType_String: sprintf_s(debugPrint, 512, "[Type=String, Value=%s]", value.str); break;
+		case kTokenType_String: sprintf_s(debugPrint, 512, "[Type=String, Value=%s]", StringData()); break;
 		case kTokenType_Form: sprintf_s(debugPrint, 512, "[Type=Form, Value=%08X]", value.formID); break;
 		case kTokenType_Ref: sprintf_s(debugPrint, 512, "[Type=Ref, Value=%s]", value.refVar->name.CStr()); break;
 		case kTokenType_Global: sprintf_s(debugPrint, 512, "[Type=Global, Value=%s]", value.global->GetName()); break;
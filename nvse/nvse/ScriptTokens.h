@@ -35,6 +35,7 @@ extern UnorderedMap<ScriptEventList*, UnorderedMap<UInt32, NVSEVarType>> g_nvseV
 struct Operator;
 struct SliceToken;
 struct ArrayElementToken;
+struct VarCache;
 struct ForEachContext;
 class ExpressionEvaluator;
 struct ScriptToken;
@@ -224,11 +225,19 @@ struct ScriptToken
 	virtual bool					GetBool();
 #if RUNTIME
 	Token_Type	ReadFrom(ExpressionEvaluator* context);	// reconstitute param from compiled data, return the type
+	// ReadFrom() once the operands are read, also used by ExpressionDiskCache to restore tokens
+	Token_Type	InitRef(ExpressionEvaluator* context, UInt16 refIdx);
+	Token_Type	InitGlobal(ExpressionEvaluator* context, UInt16 refIdx);
+	Token_Type	InitCommand(UInt16 refIdx, UInt16 opcode, UInt32 cmdOpcodeOffset);
+	Token_Type	InitVariable(ExpressionEvaluator* context, UInt8 varType, UInt16 refIdx, UInt16 varIdx);
 	virtual ArrayID					GetArray();
 	ArrayVar*						GetArrayVar();
 	ScriptEventList::Var *			GetVar() const;
 	bool ResolveVariable();
+	bool ResolveVariable(VarCache& cache);	// skips the event list lookup while cache holds the variable
+	ScriptEventList* GetVariableEventList() const;	// the list ResolveVariable() looks in
 	void							Delete() const;
+	virtual UInt8					GetOperandKind() const { return type; }	// OperandKind, what Operator::Evaluate() dispatches on
 #endif
 	virtual bool			CanConvertTo(Token_Type to) const;	// behavior varies b/w compile/run-time for ambiguous types
 	virtual ArrayID			GetOwningArrayID() const { return 0; }
@@ -282,6 +291,7 @@ struct ScriptToken
 	static ScriptToken* Create(ScriptToken* l, ScriptToken* r);
 	static ScriptToken* Create(UInt32 varID, UInt32 lbound, UInt32 ubound);
 	static ScriptToken* Create(ArrayElementToken* elem, UInt32 lbound, UInt32 ubound);
+	static ScriptToken* CreateConcat(const char* lStr, const char* rStr);
 	static ScriptToken* Create(UInt32 bogus);	// unimplemented, to block implicit conversion to double
 
 	void SetString(const char *srcStr);
@@ -291,6 +301,21 @@ struct ScriptToken
 
 	UInt16		refIdx;
 	CommandReturnType returnType;
+
+	// String tokens keep values shorter than kInlineStringSize in inlineStr and longer ones in a reference
+	// counted heap block that copies of the token share, pointed to by value.str. Which one is used follows
+	// from strLength alone: tokens are moved around with memcpy (Vector), so value.str never points at inlineStr.
+	static constexpr UInt32 kInlineStringSize = 20;
+	UInt32		strLength;
+	char		inlineStr[kInlineStringSize];
+
+	bool IsInlineString() const {return strLength < kInlineStringSize;}
+	const char* StringData() const {return !strLength ? NULL : (IsInlineString() ? inlineStr : value.str);}	// NULL if empty
+
+	char* InitString(UInt32 length);	// storage for a string of length chars, the token must not hold one
+	void InitString(const char* str, UInt32 length);
+	void ShareString(const ScriptToken& from);
+	void ReleaseString();
 #if RUNTIME
 	void* operator new(size_t size);
 	void operator delete(void* p);
@@ -361,6 +386,7 @@ struct ArrayElementToken : ScriptToken
 	TESForm*		GetTESForm() override;
 	bool			GetBool()  override;
 	bool			CanConvertTo(Token_Type to) const override;
+	UInt8			GetOperandKind() const override;
 	ArrayID			GetOwningArrayID() const override { return type == kTokenType_ArrayElement ? value.arrID : 0; }
 	void* operator new(size_t size);
 
@@ -434,10 +460,51 @@ struct AssignableSubstringArrayElementToken : public AssignableSubstringToken
 	}
 };
 
+// Operator results inside ExpressionEvaluator::Evaluate() are taken from a per thread bump arena instead
+// of g_scriptTokenAllocator. Deleting one only runs its destructor, the memory of all of them is reclaimed
+// when the outermost Evaluate() returns, after its result has been moved to pooled storage.
+namespace ScriptTokenArena
+{
+	// one per Evaluate() call, the outermost one resets the arena
+	class Frame
+	{
+		bool allocating_;
+	public:
+		Frame();
+		~Frame();
+	};
+
+	// plain ScriptTokens created while an enabled scope is active come from the arena
+	class Scope
+	{
+		bool previous_;
+	public:
+		explicit Scope(bool enable);
+		~Scope();
+	};
+
+	// token itself, or a pooled copy of it if it lives in the arena
+	ScriptToken* Promote(ScriptToken* token);
+}
+
 #endif
 
 typedef ScriptToken* (* Op_Eval)(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context);
 
+// Run-time operand kinds for the operator dispatch tables: the token type, except for array elements which
+// convert to whatever type of value they currently hold (see ArrayElementToken::CanConvertTo)
+enum OperandKind : UInt8
+{
+	kOperandKind_BadElement = kTokenType_Max,	// converts to nothing
+	kOperandKind_MissingElement,				// key not in array, converts to kTokenType_ArrayElement only
+	kOperandKind_NumericElement,
+	kOperandKind_FormElement,
+	kOperandKind_StringElement,
+	kOperandKind_ArrayElement,
+
+	kOperandKind_Max
+};
+
 struct OperationRule
 {
 	Token_Type	lhs;
@@ -482,6 +549,10 @@ struct Operator
 	bool ExpectsStringLiteral() { return type == kOpType_MemberAccess; }
 
 	Token_Type GetResult(Token_Type lhs, Token_Type rhs);	// at compile-time determine type resulting from operation
+	const OperationRule* MatchRule(Token_Type lhs, Token_Type rhs, bool& swapOrder) const;	// the rule Evaluate() picks for operands of these types, nullptr if none
+#if RUNTIME
+	static void InitDispatchTables();	// resolves the rule for every pair of operand kinds, call once before Evaluate()
+#endif
 #if !DISABLE_CACHING
 	ScriptToken* Evaluate(ScriptToken* lhs, ScriptToken* rhs, ExpressionEvaluator* context, Op_Eval& cacheEval, bool& cacheSwapOrder);	// at run-time, operate on the operands and return result
 #else
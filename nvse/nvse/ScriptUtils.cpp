@@ -11,6 +11,9 @@
 
 #include "containers.h"
 #include "FastStack.h"
+#include "ExpressionDiskCache.h"
+#include "ScriptProfiler.h"
+#include "ScriptTokenCompiler.h"
 #include "ParamInfos.h"
 #include "FunctionScripts.h"
 #include "GameRTTI.h"
@@ -241,24 +244,9 @@ ScriptToken* Eval_Add_Number(OperatorType op, ScriptToken* lh, ScriptToken* rh,
 	return ScriptToken::Create(lh->GetNumber() + rh->GetNumber());
 }
 
-char* __fastcall ConcatStrings(const char *lStr, const char *rStr)
-{
-	UInt32 lLen = StrLen(lStr), rLen = StrLen(rStr);
-	if (lLen || rLen)
-	{
-		char *conStr = (char*)malloc(lLen + rLen + 1);
-		if (lLen) memcpy(conStr, lStr, lLen);
-		memcpy(conStr + lLen, rStr, rLen + 1);
-		return conStr;
-	}
-	return "";
-}
-
 ScriptToken* Eval_Add_String(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context)
 {
-	ScriptToken *token = ScriptToken::Create((const char*)NULL);
-	token->value.str = ConcatStrings(lh->GetString(), rh->GetString());
-	return token;
+	return ScriptToken::CreateConcat(lh->GetString(), rh->GetString());
 }
 
 ScriptToken* Eval_Arithmetic(OperatorType op, ScriptToken* lh, ScriptToken* rh, ExpressionEvaluator* context)
@@ -639,12 +627,12 @@ ScriptToken* Eval_PlusEquals_Elem_Number(OperatorType op, ScriptToken* lh, Scrip
 	const ArrayKey* key = lh->GetArrayKey();
 	if (key)
 	{
-		ArrayElement *elem = g_ArrayMap.GetElement(lh->GetOwningArrayID(), key);
+		ArrayVar *arr = g_ArrayMap.Get(lh->GetOwningArrayID());
 		double elemVal;
-		if (elem && elem->GetAsNumber(&elemVal))
+		if (arr && arr->GetElementNumber(key, &elemVal))
 		{
 			elemVal += rh->GetNumber();
-			elem->SetNumber(elemVal);
+			arr->SetElementNumber(key, elemVal);
 			return ScriptToken::Create(elemVal);
 		}
 	}
@@ -657,12 +645,12 @@ ScriptToken* Eval_MinusEquals_Elem_Number(OperatorType op, ScriptToken* lh, Scri
 	const ArrayKey* key = lh->GetArrayKey();
 	if (key)
 	{
-		ArrayElement *elem = g_ArrayMap.GetElement(lh->GetOwningArrayID(), key);
+		ArrayVar *arr = g_ArrayMap.Get(lh->GetOwningArrayID());
 		double elemVal;
-		if (elem && elem->GetAsNumber(&elemVal))
+		if (arr && arr->GetElementNumber(key, &elemVal))
 		{
 			elemVal -= rh->GetNumber();
-			elem->SetNumber(elemVal);
+			arr->SetElementNumber(key, elemVal);
 			return ScriptToken::Create(elemVal);
 		}
 	}
@@ -675,12 +663,12 @@ ScriptToken* Eval_TimesEquals_Elem(OperatorType op, ScriptToken* lh, ScriptToken
 	const ArrayKey* key = lh->GetArrayKey();
 	if (key)
 	{
-		ArrayElement *elem = g_ArrayMap.GetElement(lh->GetOwningArrayID(), key);
+		ArrayVar *arr = g_ArrayMap.Get(lh->GetOwningArrayID());
 		double elemVal;
-		if (elem && elem->GetAsNumber(&elemVal))
+		if (arr && arr->GetElementNumber(key, &elemVal))
 		{
 			elemVal *= rh->GetNumber();
-			elem->SetNumber(elemVal);
+			arr->SetElementNumber(key, elemVal);
 			return ScriptToken::Create(elemVal);
 		}
 	}
@@ -693,15 +681,15 @@ ScriptToken* Eval_DividedEquals_Elem(OperatorType op, ScriptToken* lh, ScriptTok
 	const ArrayKey* key = lh->GetArrayKey();
 	if (key)
 	{
-		ArrayElement *elem = g_ArrayMap.GetElement(lh->GetOwningArrayID(), key);
+		ArrayVar *arr = g_ArrayMap.Get(lh->GetOwningArrayID());
 		double elemVal;
-		if (elem && elem->GetAsNumber(&elemVal))
+		if (arr && arr->GetElementNumber(key, &elemVal))
 		{
 			double result = rh->GetNumber();
 			if (result != 0.0)
 			{
 				elemVal /= result;
-				elem->SetNumber(elemVal);
+				arr->SetElementNumber(key, elemVal);
 				return ScriptToken::Create(elemVal);
 			}
 			context->Error("Division by zero");
@@ -716,12 +704,12 @@ ScriptToken* Eval_ExponentEquals_Elem(OperatorType op, ScriptToken* lh, ScriptTo
 	const ArrayKey* key = lh->GetArrayKey();
 	if (key)
 	{
-		ArrayElement *elem = g_ArrayMap.GetElement(lh->GetOwningArrayID(), key);
+		ArrayVar *arr = g_ArrayMap.Get(lh->GetOwningArrayID());
 		double elemVal;
-		if (elem && elem->GetAsNumber(&elemVal))
+		if (arr && arr->GetElementNumber(key, &elemVal))
 		{
 			double result = pow(elemVal, rh->GetNumber());
-			elem->SetNumber(result);
+			arr->SetElementNumber(key, result);
 			return ScriptToken::Create(result);
 		}
 	}
@@ -738,10 +726,8 @@ ScriptToken* Eval_PlusEquals_Elem_String(OperatorType op, ScriptToken* lh, Scrip
 		const char* pElemStr;
 		if (elem && elem->GetAsString(&pElemStr))
 		{
-			ScriptToken *token = ScriptToken::Create((const char*)NULL);
-			char *conStr = ConcatStrings(pElemStr, rh->GetString());
-			token->value.str = conStr;
-			elem->SetString(conStr);
+			ScriptToken *token = ScriptToken::CreateConcat(pElemStr, rh->GetString());
+			elem->SetString(token->GetString());
 			return token;
 		}
 	}
@@ -3413,13 +3399,13 @@ bool ExpressionEvaluator::ConvertDefaultArg(ScriptToken* arg, ParamInfo* info, b
 	return true;
 }
 
-ScriptToken* ExpressionEvaluator::ExecuteCommandToken(ScriptToken const* token)
+bool ExpressionEvaluator::ExecuteCommand(ScriptToken const* token, double& cmdResult)
 {
 	// execute the command
 	CommandInfo* cmdInfo = token->GetCommandInfo();
 	if (!cmdInfo)
 	{
-		return nullptr;
+		return false;
 	}
 
 	TESObjectREFR* callingObj = m_thisObj;
@@ -3430,19 +3416,19 @@ ScriptToken* ExpressionEvaluator::ExecuteCommandToken(ScriptToken const* token)
 		if (!callingRef->form)
 		{
 			Error("Attempting to call a function on a NULL reference");
-			return nullptr;
+			return false;
 		}
 		if (!callingRef->form->GetIsReference())
 		{
 			Error("Attempting to call a function on a base object (this must be a reference)");
-			return nullptr;
+			return false;
 		}
 		callingObj = DYNAMIC_CAST(callingRef->form, TESForm, TESObjectREFR);
 	}
 
 
 	TESObjectREFR* contObj = callingRef ? NULL : m_containingObj;
-	double cmdResult = 0;
+	cmdResult = 0;
 
 	//UInt32 numBytesRead = 0;
 	//UInt8* scrData = Data();
@@ -3450,17 +3436,29 @@ ScriptToken* ExpressionEvaluator::ExecuteCommandToken(ScriptToken const* token)
 
 	//*m_opcodeOffsetPtr = m_data - m_scriptData;
 	UInt32 opcodeOffset = token->cmdOpcodeOffset;
-	CommandReturnType retnType = token->returnType;
 
 	ExpectReturnType(kRetnType_Default);	// expect default return type unless called command specifies otherwise
+	ScriptProfiler::Scope profilerScope(ScriptProfiler::Kind::Command, script, opcodeOffset, cmdInfo->opcode, cmdInfo->longName);
 	bool bExecuted = cmdInfo->execute(cmdInfo->params, m_scriptData, callingObj, contObj, script, eventList, &cmdResult, &opcodeOffset);
 
 	if (!bExecuted)
 	{
 		Error("Command %s failed to execute", cmdInfo->longName);
+		return false;
+	}
+	return true;
+}
+
+ScriptToken* ExpressionEvaluator::ExecuteCommandToken(ScriptToken const* token)
+{
+	double cmdResult;
+	if (!ExecuteCommand(token, cmdResult))
+	{
 		return nullptr;
 	}
 
+	CommandReturnType retnType = token->returnType;
+
 	if (retnType == kRetnType_Ambiguous || retnType == kRetnType_ArrayIndex)	// return type ambiguous, cmd will inform us of type to expect
 	{
 		retnType = GetExpectedReturnType();
@@ -3566,6 +3564,180 @@ void ParseShortCircuit(CachedTokens& cachedTokens)
 	}
 }
 
+// result type of operator routines which only depend on their operands, kTokenType_Invalid for the rest
+Token_Type GetPureEvalResult(Op_Eval eval)
+{
+	if (eval == Eval_Add_Number || eval == Eval_Arithmetic || eval == Eval_Integer || eval == Eval_Negation)
+		return kTokenType_Number;
+	if (eval == Eval_Comp_Number_Number || eval == Eval_Comp_String_String || eval == Eval_Eq_Number || eval == Eval_Eq_String
+		|| eval == Eval_Logical || eval == Eval_LogicalNot)
+		return kTokenType_Boolean;
+	if (eval == Eval_Add_String)
+		return kTokenType_String;
+	return kTokenType_Invalid;
+}
+
+// type an operand will have every time the expression runs, kTokenType_Invalid if it can change
+Token_Type GetStaticOperandType(const ScriptToken& token)
+{
+	switch (token.Type())
+	{
+	case kTokenType_Number:
+	case kTokenType_Boolean:
+	case kTokenType_String:
+	case kTokenType_Global:
+	case kTokenType_NumericVar:
+	case kTokenType_StringVar:
+	case kTokenType_ArrayVar:
+	case kTokenType_RefVar:
+		return token.Type();
+	default:
+		return kTokenType_Invalid;
+	}
+}
+
+// Folds operators whose operands are all literals into a single literal token and binds the operator
+// routine of every operator whose operand types are known, exactly as Operator::Evaluate would on first
+// run. Must run before ParseShortCircuit since folding moves tokens.
+void FoldConstants(CachedTokens& cachedTokens, ExpressionEvaluator& context)
+{
+	struct StaticOperand
+	{
+		UInt32		first;	// index of the first token of the subexpression
+		Token_Type	type;
+		bool		literal;
+	};
+	std::vector<StaticOperand> stack;
+	for (UInt32 i = 0; i < cachedTokens.Size(); i++)
+	{
+		TokenCacheEntry &entry = cachedTokens.Get(i);
+		ScriptToken &token = entry.token;
+		if (!token.IsOperator())
+		{
+			const Token_Type type = GetStaticOperandType(token);
+			const bool literal = type == kTokenType_Number || type == kTokenType_Boolean || type == kTokenType_String;
+			stack.push_back(StaticOperand{i, type, literal});
+			continue;
+		}
+
+		Operator *op = token.GetOperator();
+		if (op->numOperands == 0 || op->numOperands > 2 || op->numOperands > stack.size())
+			return;	// Evaluate reports it
+		StaticOperand rhs{i, kTokenType_Invalid, true};
+		if (op->numOperands == 2)
+		{
+			rhs = stack.back();
+			stack.pop_back();
+		}
+		const StaticOperand lhs = stack.back();
+		stack.pop_back();
+
+		const bool known = lhs.type != kTokenType_Invalid && (op->numOperands == 1 || rhs.type != kTokenType_Invalid);
+		bool swapOrder;
+		const OperationRule *rule = known ? op->MatchRule(lhs.type, rhs.type, swapOrder) : nullptr;
+		if (!rule)
+		{
+			stack.push_back(StaticOperand{lhs.first, kTokenType_Invalid, false});
+			continue;
+		}
+		entry.eval = rule->eval;
+		entry.swapOrder = swapOrder;
+
+		const Token_Type resultType = GetPureEvalResult(rule->eval);
+		if (resultType == kTokenType_Invalid || !lhs.literal || !rhs.literal)
+		{
+			stack.push_back(StaticOperand{lhs.first, resultType, false});
+			continue;
+		}
+
+		ScriptToken *lhToken = &cachedTokens.Get(lhs.first).token;
+		ScriptToken *rhToken = op->numOperands == 2 ? &cachedTokens.Get(rhs.first).token : nullptr;
+		if (swapOrder)
+			std::swap(lhToken, rhToken);
+		// leave errors to run time; division and modulo by zero are the only ones a pure routine reports, concatenating
+		// literal strings (empty ones included) always succeeds and is folded
+		if ((op->type == kOpType_Divide || op->type == kOpType_Modulo) && SInt64(rhToken->GetNumber()) == 0)
+		{
+			stack.push_back(StaticOperand{lhs.first, resultType, false});
+			continue;
+		}
+		ScriptToken *result = rule->eval(op->type, lhToken, rhToken, &context);
+		if (!result)
+		{
+			stack.push_back(StaticOperand{lhs.first, resultType, false});
+			continue;
+		}
+
+		TokenCacheEntry &folded = cachedTokens.Get(lhs.first);
+		Script *owningScript = folded.token.owningScript;
+		folded.token = *result;
+		folded.token.owningScript = owningScript;
+		folded.token.cached = true;
+		folded.eval = nullptr;
+		folded.swapOrder = false;
+		result->Delete();
+		cachedTokens.Remove(lhs.first + 1, i - lhs.first);
+		i = lhs.first;
+		stack.push_back(StaticOperand{lhs.first, resultType, true});
+	}
+}
+
+static bool IsNumericCommand(const ScriptToken& token)
+{
+	return token.Type() == kTokenType_Command && token.returnType == kRetnType_Default;
+}
+
+// see ConditionShape, the shapes the token cache can run without creating tokens
+ConditionShape GetConditionShape(CachedTokens& cachedTokens)
+{
+	if (cachedTokens.compiled)
+		return ConditionShape::Compiled;
+
+	if (cachedTokens.Size() == 1)
+	{
+		const ScriptToken &token = cachedTokens.Get(0).token;
+		if (IsNumericCommand(token) || token.Type() == kTokenType_Command && token.returnType == kRetnType_Form)
+			return ConditionShape::Command;
+	}
+	else if (cachedTokens.Size() == 3)
+	{
+		const ScriptToken &lhs = cachedTokens.Get(0).token;
+		const ScriptToken &rhs = cachedTokens.Get(1).token;
+		const ScriptToken &op = cachedTokens.Get(2).token;
+		if (op.IsOperator() && (IsNumericCommand(lhs) && rhs.Type() == kTokenType_Number || lhs.Type() == kTokenType_Number && IsNumericCommand(rhs)))
+		{
+			bool swapOrder;
+			const OperationRule *rule = op.GetOperator()->MatchRule(kTokenType_Number, kTokenType_Number, swapOrder);
+			if (rule && (rule->eval == Eval_Comp_Number_Number || rule->eval == Eval_Eq_Number))
+				return ConditionShape::CompareCommand;
+		}
+	}
+	return ConditionShape::Generic;
+}
+
+// same results as Eval_Comp_Number_Number and Eval_Eq_Number
+static bool CompareNumbers(OperatorType op, double lhs, double rhs)
+{
+	switch (op)
+	{
+	case kOpType_GreaterThan:		return lhs > rhs;
+	case kOpType_LessThan:			return lhs < rhs;
+	case kOpType_GreaterOrEqual:	return lhs >= rhs;
+	case kOpType_LessOrEqual:		return lhs <= rhs;
+	case kOpType_Equals:			return FloatEqual(lhs, rhs);
+	case kOpType_NotEqual:			return !FloatEqual(lhs, rhs);
+	default:						return false;
+	}
+}
+
+// everything derived from the parsed tokens that ExpressionDiskCache doesn't store
+static void PrepareTokens(CachedTokens& cachedTokens)
+{
+	cachedTokens.AssignStateSlots();
+	cachedTokens.compiled = CompiledExpression::Compile(cachedTokens);
+	cachedTokens.condition = GetConditionShape(cachedTokens);
+}
+
 bool ExpressionEvaluator::ParseBytecode(CachedTokens& cachedTokens)
 {
 	const UInt8 *dataBeforeParsing = m_data;
@@ -3579,7 +3751,9 @@ bool ExpressionEvaluator::ParseBytecode(CachedTokens& cachedTokens)
 		entry->token.cached = true;
 	}
 	cachedTokens.incrementData = m_data - dataBeforeParsing;
+	FoldConstants(cachedTokens, *this);
 	ParseShortCircuit(cachedTokens);
+	PrepareTokens(cachedTokens);
 	return true;
 }
 
@@ -3616,22 +3790,134 @@ void CopyShortCircuitInfo(ScriptToken* to, ScriptToken* from)
 }
 
 thread_local TokenCache g_tokenCache;
+thread_local UInt32 ExpressionEvaluator::s_fastPaths = kFastPath_All;
+
+TokenCache::Entry* ExpressionEvaluator::GetCachedTokens(UInt8* cacheKey)
+{
+	TokenCache::Entry &cached = g_tokenCache.Get(cacheKey);
+	if (!cached.tokens)
+	{
+		cached.tokens = TokenCache::FindShared(cacheKey);
+		if (!cached.tokens)
+		{
+			auto tokens = std::make_shared<CachedTokens>();
+			if (m_scriptData == script->data && ExpressionDiskCache::Restore(*this, m_data, *tokens))
+			{
+				m_data += tokens->incrementData;
+				PrepareTokens(*tokens);
+			}
+			else
+			{
+				UInt8 *data = m_data;
+				if (!ParseBytecode(*tokens))
+				{
+					Error("Failed to parse script data");
+					return nullptr;
+				}
+				if (m_scriptData == script->data)
+					ExpressionDiskCache::Record(*this, data, *tokens);
+			}
+			cached.tokens = TokenCache::Publish(cacheKey, std::move(tokens));
+		}
+		else
+		{
+			m_data += cached.tokens->incrementData;
+		}
+		cached.state.Init(*cached.tokens);
+	}
+	else
+	{
+		m_data += cached.tokens->incrementData;
+	}
+	return &cached;
+}
 
 ScriptToken* ExpressionEvaluator::Evaluate()
 {
+	ScriptTokenArena::Frame arenaFrame;
+	UInt8 *cacheKey = GetCommandOpcodePosition();
+	ScriptProfiler::Scope profilerScope(ScriptProfiler::Kind::Expression, script, cacheKey - m_scriptData);
+	TokenCache::Entry *cached = GetCachedTokens(cacheKey);
+	if (!cached)
+		return nullptr;
+	return Evaluate(*cached->tokens, cached->state);
+}
+
+bool ExpressionEvaluator::ExtractCondition(bool& result)
+{
+	if (ReadByte() != 1)
+		return false;
+
+	ScriptTokenArena::Frame arenaFrame;
 	UInt8 *cacheKey = GetCommandOpcodePosition();
-	CachedTokens &cache = g_tokenCache.Get(cacheKey);
-	if (cache.Empty())
+	ScriptProfiler::Scope profilerScope(ScriptProfiler::Kind::Expression, script, cacheKey - m_scriptData);
+	TokenCache::Entry *cached = GetCachedTokens(cacheKey);
+	if (!cached)
+		return false;
+	CachedTokens &cache = *cached->tokens;
+	TokenEvalState &state = cached->state;
+
+	double value = 0;
+	UInt32 faultingToken = 0;
+	bool success;
+	ConditionShape shape = cache.condition;
+	if (!(s_fastPaths & kFastPath_Conditions) || shape == ConditionShape::Compiled && !(s_fastPaths & kFastPath_RegisterCode))
+		shape = ConditionShape::Generic;
+	switch (shape)
 	{
-		if (!ParseBytecode(cache))
+	case ConditionShape::Compiled:
+		success = cache.compiled->Execute(cache, state, *this, faultingToken, value);
+		break;
+	case ConditionShape::Command:
+		success = ExecuteCommand(&cache.Get(0).token, value);
+		if (success && cache.Get(0).token.returnType == kRetnType_Form)
+			value = *reinterpret_cast<UInt32*>(&value);
+		break;
+	case ConditionShape::CompareCommand:
+	{
+		const ScriptToken &lhs = cache.Get(0).token;
+		const ScriptToken &rhs = cache.Get(1).token;
+		faultingToken = lhs.Type() == kTokenType_Command ? 0 : 1;
+		double cmdResult;
+		success = ExecuteCommand(&cache.Get(faultingToken).token, cmdResult);
+		if (success)
 		{
-			Error("Failed to parse script data");
-			return nullptr;
+			const auto op = cache.Get(2).token.GetOperator()->type;
+			value = faultingToken == 0 ? CompareNumbers(op, cmdResult, rhs.value.num) : CompareNumbers(op, lhs.value.num, cmdResult);
 		}
+		break;
 	}
-	else
+	default:
+	{
+		ScriptToken *token = Evaluate(cache, state);
+		if (!token)
+			return false;
+		result = token->GetBool();
+		token->Delete();
+		return true;
+	}
+	}
+
+	*m_opcodeOffsetPtr += cache.incrementData;
+	if (!success || HasErrors())
 	{
-		m_data += cache.incrementData;
+		ReportFailedExpression(cache, state, cache.Get(faultingToken).token);
+		return false;
+	}
+	result = value != 0;
+	return true;
+}
+
+ScriptToken* ExpressionEvaluator::Evaluate(CachedTokens& cache, TokenEvalState& state)
+{
+	if (cache.compiled && s_fastPaths & kFastPath_RegisterCode)
+	{
+		UInt32 faultingToken = 0;
+		ScriptToken* result = cache.compiled->Execute(cache, state, *this, faultingToken);
+		*m_opcodeOffsetPtr += cache.incrementData;
+		if (!result)
+			ReportFailedExpression(cache, state, cache.Get(faultingToken).token);
+		return result;
 	}
 
 	OperandStack operands;
@@ -3640,7 +3926,6 @@ ScriptToken* ExpressionEvaluator::Evaluate()
 	{
 		TokenCacheEntry &entry = iter.Get();
 		ScriptToken *curToken = &entry.token;
-		curToken->context = this;
 
 		if (curToken->Type() != kTokenType_Operator)
 		{
@@ -3654,10 +3939,15 @@ ScriptToken* ExpressionEvaluator::Evaluate()
 				CopyShortCircuitInfo(cmdToken, curToken);
 				curToken = cmdToken;
 			}
-			else if (curToken->IsVariable() && !curToken->ResolveVariable())
+			else if (curToken->IsVariable())
 			{
-				Error("Failed to resolve variable");
-				break;
+				curToken = &state.vars[entry.stateIdx];
+				curToken->context = this;
+				if (!curToken->ResolveVariable(state.varCaches[entry.stateIdx]))
+				{
+					Error("Failed to resolve variable");
+					break;
+				}
 			}
 			operands.Push(curToken);
 		}
@@ -3684,13 +3974,26 @@ ScriptToken* ExpressionEvaluator::Evaluate()
 			}
 
 			ScriptToken* opResult;
-			if (entry.eval == nullptr)
 			{
-				opResult = op->Evaluate(lhOperand, rhOperand, this, entry.eval, entry.swapOrder);
-			}
-			else
-			{
-				opResult = entry.swapOrder ? entry.eval(op->type, rhOperand, lhOperand, this) : entry.eval(op->type, lhOperand, rhOperand, this);
+				// pairs keep copies of their operands, which must outlive the arena
+				ScriptTokenArena::Scope arenaScope(op->type != kOpType_MakePair);
+				Op_Eval eval = entry.eval;
+				bool swapOrder = entry.swapOrder;
+				TokenEvalState::Binding *binding = nullptr;
+				if (eval == nullptr)
+				{
+					binding = &state.bindings[entry.stateIdx];
+					eval = binding->eval;
+					swapOrder = binding->swapOrder;
+				}
+				if (eval == nullptr)
+				{
+					opResult = op->Evaluate(lhOperand, rhOperand, this, binding->eval, binding->swapOrder);
+				}
+				else
+				{
+					opResult = swapOrder ? eval(op->type, rhOperand, lhOperand, this) : eval(op->type, lhOperand, rhOperand, this);
+				}
 			}
 
 
@@ -3719,18 +4022,7 @@ ScriptToken* ExpressionEvaluator::Evaluate()
 
 	if (operands.Size() != 1 || this->HasErrors())		// should have one operand remaining - result of expression
 	{
-		const auto currentLine = this->GetLineText(cache, iter.Get().token);
-		if (!currentLine.empty())
-		{
-			Error("Script line approximation: %s (error wrapped in ##'s)", currentLine.c_str());
-			const auto variablesText = this->GetVariablesText(cache);
-			if (!variablesText.empty())
-				Error("\tWhere %s", variablesText.c_str());
-		}
-		else
-		{
-			Error("An expression failed to evaluate to a valid result. (Failed to approximate script line)");
-		}
+		ReportFailedExpression(cache, state, iter.Get().token);
 		while (operands.Size())
 		{
 			ScriptToken *operand = operands.Top();
@@ -3741,7 +4033,23 @@ ScriptToken* ExpressionEvaluator::Evaluate()
 		return nullptr;
 	}
 
-	return operands.Top();
+	return ScriptTokenArena::Promote(operands.Top());
+}
+
+void ExpressionEvaluator::ReportFailedExpression(CachedTokens& cachedTokens, TokenEvalState& state, ScriptToken& faultingToken)
+{
+	const auto currentLine = this->GetLineText(cachedTokens, faultingToken);
+	if (!currentLine.empty())
+	{
+		Error("Script line approximation: %s (error wrapped in ##'s)", currentLine.c_str());
+		const auto variablesText = this->GetVariablesText(cachedTokens, state);
+		if (!variablesText.empty())
+			Error("\tWhere %s", variablesText.c_str());
+	}
+	else
+	{
+		Error("An expression failed to evaluate to a valid result. (Failed to approximate script line)");
+	}
 }
 
 std::string ExpressionEvaluator::GetLineText(CachedTokens& tokens, ScriptToken& faultingToken) const
@@ -3757,6 +4065,7 @@ std::string ExpressionEvaluator::GetLineText(CachedTokens& tokens, ScriptToken&
 			switch (token.Type())
 			{
 			case kTokenType_Number:
+			case kTokenType_Boolean:
 				operands.push(FormatString("%g", token.GetNumber()));
 				break;
 			case kTokenType_String:
@@ -3884,13 +4193,13 @@ std::string ExpressionEvaluator::GetLineText(CachedTokens& tokens, ScriptToken&
 	return "";
 }
 
-std::string ExpressionEvaluator::GetVariablesText(CachedTokens& tokens) const
+std::string ExpressionEvaluator::GetVariablesText(CachedTokens& tokens, TokenEvalState& state) const
 {
 	std::string result;
 	std::set<std::pair<UInt32, UInt32>> printedVars;
 	for (auto iter = tokens.Begin(); !iter.End(); ++iter)
 	{
-		auto& token = iter.Get().token;
+		auto& token = iter.Get().token.IsVariable() ? state.vars[iter.Get().stateIdx] : iter.Get().token;
 		if (printedVars.find(std::make_pair(token.refIdx, token.varIdx)) != printedVars.end())
 			continue;
 		if (token.IsVariable())
@@ -3934,49 +4243,97 @@ std::string ExpressionEvaluator::GetVariablesText(CachedTokens& tokens) const
 //	check operand(s)->CanConvertTo() for rule types (also swap them and test if !asymmetric)
 //	if can convert --> pass to rule handler, return result :: else, continue loop
 //	if no matching rule return null
-ScriptToken* Operator::Evaluate(ScriptToken* lhs, ScriptToken* rhs, ExpressionEvaluator* context, Op_Eval& cacheEval, bool& cacheSwapOrder)
+// per operator and pair of operand kinds, the index of the rule to evaluate with, kDispatch_SwapOrder set if
+// the operands have to be swapped for it
+enum
 {
-	if (numOperands == 0)	// how'd we get here?
+	kDispatch_SwapOrder	= 0x80,
+	kDispatch_NoRule	= 0xFF,
+};
+
+static UInt8 s_operatorDispatch[kOpType_Max][kOperandKind_Max][kOperandKind_Max];
+
+static bool CanConvertOperandKind(UInt8 from, Token_Type to)
+{
+	switch (from)
 	{
-		context->Error("Attempting to evaluate %s but this operator takes no operands", this->symbol);
-		return NULL;
+	case kOperandKind_BadElement:
+		return false;
+	case kOperandKind_MissingElement:
+		return to == kTokenType_ArrayElement;
+	case kOperandKind_NumericElement:
+		return to == kTokenType_ArrayElement || to == kTokenType_Number || to == kTokenType_Boolean;
+	case kOperandKind_FormElement:
+		return to == kTokenType_ArrayElement || to == kTokenType_Form || to == kTokenType_Boolean;
+	case kOperandKind_StringElement:
+		return to == kTokenType_ArrayElement || to == kTokenType_String;
+	case kOperandKind_ArrayElement:
+		return to == kTokenType_ArrayElement || to == kTokenType_Array;
+	default:
+		return CanConvertOperand(static_cast<Token_Type>(from), to);
 	}
+}
 
-	for (UInt32 i = 0; i < numRules; i++)
+void Operator::InitDispatchTables()
+{
+	for (UInt32 opType = 0; opType < kOpType_Max; opType++)
 	{
-		bool bRuleMatches = false;
-		bool bSwapOrder = false;
-		OperationRule* rule = &rules[i];
-		if (!rule->eval)
-			continue;
-
-		if (IsUnary() && lhs->CanConvertTo(rule->lhs))
-			bRuleMatches = true;
-		else
+		const Operator& op = s_operators[opType];
+		ASSERT(op.numRules < kDispatch_SwapOrder);
+		for (UInt32 lhs = 0; lhs < kOperandKind_Max; lhs++)
 		{
-			if (lhs->CanConvertTo(rule->lhs) && rhs->CanConvertTo(rule->rhs))
-				bRuleMatches = true;
-			else if (!rule->bAsymmetric && rhs->CanConvertTo(rule->lhs) && lhs->CanConvertTo(rule->rhs))
+			for (UInt32 rhs = 0; rhs < kOperandKind_Max; rhs++)
 			{
-				bSwapOrder = true;
-				bRuleMatches = true;
-			}
-		}
-		if (bRuleMatches)
-		{
-			if (lhs->Type() != kTokenType_ArrayElement && rhs ? rhs->Type() != kTokenType_ArrayElement : true) // array elements depend on CanConvertTo to fail, can't cache eval
-			{
-				cacheEval = rule->eval;
-				cacheSwapOrder = bSwapOrder;
+				// first matching rule in the order Evaluate() used to scan them, unary operators ignore rhs
+				UInt8& dispatch = s_operatorDispatch[opType][lhs][rhs];
+				dispatch = kDispatch_NoRule;
+				for (UInt32 i = 0; i < op.numRules; i++)
+				{
+					const OperationRule& rule = op.rules[i];
+					if (!rule.eval)
+						continue;
+					if (op.numOperands == 1)
+					{
+						if (CanConvertOperandKind(lhs, rule.lhs))
+							dispatch = i;
+					}
+					else if (CanConvertOperandKind(lhs, rule.lhs) && CanConvertOperandKind(rhs, rule.rhs))
+						dispatch = i;
+					else if (!rule.bAsymmetric && CanConvertOperandKind(rhs, rule.lhs) && CanConvertOperandKind(lhs, rule.rhs))
+						dispatch = i | kDispatch_SwapOrder;
+					if (dispatch != kDispatch_NoRule)
+						break;
+				}
 			}
-			return bSwapOrder ? rule->eval(type, rhs, lhs, context) : rule->eval(type, lhs, rhs, context);
 		}
 	}
-	if (rhs && rhs->Type() == kTokenType_ArrayElement || lhs && lhs->Type() == kTokenType_ArrayElement)
+}
+
+ScriptToken* Operator::Evaluate(ScriptToken* lhs, ScriptToken* rhs, ExpressionEvaluator* context, Op_Eval& cacheEval, bool& cacheSwapOrder)
+{
+	if (numOperands == 0)	// how'd we get here?
+	{
+		context->Error("Attempting to evaluate %s but this operator takes no operands", this->symbol);
+		return NULL;
+	}
+
+	const UInt8 dispatch = s_operatorDispatch[type][lhs->GetOperandKind()][IsUnary() ? 0 : rhs->GetOperandKind()];
+	const bool hasArrayElement = lhs->Type() == kTokenType_ArrayElement || rhs && rhs->Type() == kTokenType_ArrayElement;
+	if (dispatch == kDispatch_NoRule)
 	{
-		context->Error("Array does not contain key");
+		if (hasArrayElement)
+			context->Error("Array does not contain key");
+		return nullptr;
 	}
-	return nullptr;
+
+	const Op_Eval eval = rules[dispatch & ~kDispatch_SwapOrder].eval;
+	const bool bSwapOrder = (dispatch & kDispatch_SwapOrder) != 0;
+	if (!hasArrayElement) // array elements can hold another type of value next time, can't cache eval
+	{
+		cacheEval = eval;
+		cacheSwapOrder = bSwapOrder;
+	}
+	return bSwapOrder ? eval(type, rhs, lhs, context) : eval(type, lhs, rhs, context);
 }
 
 bool BasicTokenToElem(ScriptToken* token, ArrayElement& elem, ExpressionEvaluator* context)
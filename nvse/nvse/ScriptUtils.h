@@ -105,6 +105,9 @@ class ExpressionEvaluator
 
 	CommandReturnType GetExpectedReturnType() { CommandReturnType type = m_expectedReturnType; m_expectedReturnType = kRetnType_Default; return type; }
 	bool ParseBytecode(CachedTokens& cachedTokens);
+	TokenCache::Entry* GetCachedTokens(UInt8* cacheKey);	// advances past the expression, nullptr if it fails to parse
+	ScriptToken* Evaluate(CachedTokens& cache, TokenEvalState& state);
+	void ReportFailedExpression(CachedTokens& cachedTokens, TokenEvalState& state, ScriptToken& faultingToken);
 
 	void PushOnStack();
 	void PopFromStack() const;
@@ -112,6 +115,17 @@ public:
 	static bool	Active();
 	static ExpressionEvaluator& Get();
 
+	// shortcuts the token cache takes past the RPN interpreter, BenchmarkExpressions turns them off on its
+	// thread to time the same scripts both ways
+	enum
+	{
+		kFastPath_RegisterCode	= 1 << 0,	// see CompiledExpression
+		kFastPath_Conditions	= 1 << 1,	// see ConditionShape
+
+		kFastPath_All			= kFastPath_RegisterCode | kFastPath_Conditions,
+	};
+	static thread_local UInt32 s_fastPaths;
+
 	ExpressionEvaluator(COMMAND_ARGS);
 	~ExpressionEvaluator();
 
@@ -124,6 +138,9 @@ public:
 	// extract args compiled by ExpressionParser
 	bool			ExtractArgs();
 
+	// extract the single arg of 'if eval' as a bool, common conditions run without creating tokens
+	bool			ExtractCondition(bool& result);
+
 	// extract args to function which normally uses Cmd_Default_Parse but has been compiled instead by ExpressionParser
 	// bConvertTESForms will be true if invoked from ExtractArgs(), false if from ExtractArgsEx()
 	bool			ExtractDefaultArgs(va_list varArgs, bool bConvertTESForms);
@@ -134,10 +151,11 @@ public:
 	// extract formatted string args compiled with compiler override
 	bool ExtractFormatStringArgs(va_list varArgs, UInt32 fmtStringPos, char* fmtStringOut, UInt32 maxParams);
 
+	bool			ExecuteCommand(ScriptToken const* token, double& cmdResult);	// raw result, not converted to the return type
 	ScriptToken*	ExecuteCommandToken(ScriptToken const* token);
 	ScriptToken*	Evaluate();			// evaluates a single argument/token
 	std::string GetLineText(CachedTokens& tokens, ScriptToken& faultingToken) const;
-	std::string GetVariablesText(CachedTokens& tokens) const;
+	std::string GetVariablesText(CachedTokens& tokens, TokenEvalState& state) const;
 
 	ScriptToken*	Arg(UInt32 idx)
 	{
@@ -4,6 +4,8 @@
 #include "common/ICriticalSection.h"
 #include <vector>
 #include <list>
+#include <memory>
+#include <type_traits>
 
 
 
@@ -108,4 +110,45 @@ namespace SmallObjectsAllocator
 #endif
 		}
 	};
+
+	// Bump allocator for objects that are all released together with Reset(), there is no per object
+	// free. Objects must have been destroyed before Reset(). Blocks are kept for reuse once allocated.
+	template <class T, std::size_t C>
+	class ArenaAllocator
+	{
+		using Block = std::aligned_storage_t<sizeof(T) * C, alignof(T)>;
+		std::vector<std::unique_ptr<Block>> blocks_;
+		std::size_t numUsedBlocks_ = 0;	// including the current one
+		std::size_t used_ = C;			// objects handed out from the current block
+
+	public:
+		T* Allocate()
+		{
+			if (used_ == C)
+			{
+				if (numUsedBlocks_ == blocks_.size())
+					blocks_.emplace_back(new Block);
+				++numUsedBlocks_;
+				used_ = 0;
+			}
+			return reinterpret_cast<T*>(blocks_[numUsedBlocks_ - 1].get()) + used_++;
+		}
+
+		bool Owns(const void* ptr) const
+		{
+			for (std::size_t i = 0; i < numUsedBlocks_; i++)
+			{
+				const auto* begin = reinterpret_cast<const T*>(blocks_[i].get());
+				if (static_cast<const T*>(ptr) >= begin && static_cast<const T*>(ptr) < begin + C)
+					return true;
+			}
+			return false;
+		}
+
+		void Reset()
+		{
+			numUsedBlocks_ = 0;
+			used_ = C;
+		}
+	};
 }
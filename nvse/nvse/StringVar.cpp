@@ -364,8 +364,8 @@ bool AssignToStringVar(COMMAND_ARGS, const char* newValue) {	// Adds another cal
 
 void StringVarMap::Clean()		// clean up any temporary vars
 {
-	while (!tempIDs.Empty())
-		Delete(tempIDs.LastKey());
+	while (ids.HasTemporary())
+		Delete(ids.LastTemporary());
 }
 
 namespace PluginAPI
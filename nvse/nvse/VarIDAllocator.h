@@ -0,0 +1,91 @@
+#pragma once
+#include <vector>
+
+// IDs of the vars in a VarMap, with O(1) allocation and release. Released IDs go on a free list and are
+// flagged in a bitmap, so that loading can claim a specific one without searching the list; entries claimed
+// that way stay in the list and are skipped when popped. Temporary IDs are kept in a dense array along with
+// the position of each ID in it.
+class VarIDAllocator
+{
+	std::vector<UInt32>	freeList;
+	std::vector<UInt32>	freeBits;		// bit per ID, set while it is available
+	std::vector<UInt32>	temps;
+	std::vector<UInt32>	tempIndex;		// per ID, 1 + its index in temps, 0 if not temporary
+	UInt32				nextID = 1;		// IDs from here on were never used
+
+	bool IsFree(UInt32 id) const
+	{
+		return (id >> 5) < freeBits.size() && freeBits[id >> 5] & (1 << (id & 0x1F));
+	}
+
+public:
+	UInt32 Allocate()
+	{
+		while (!freeList.empty())
+		{
+			const UInt32 id = freeList.back();
+			freeList.pop_back();
+			if (IsFree(id))
+			{
+				freeBits[id >> 5] &= ~(1 << (id & 0x1F));
+				return id;
+			}
+		}
+		return nextID++;
+	}
+
+	// marks id as used, for vars inserted with a given ID
+	void Claim(UInt32 id)
+	{
+		if (IsFree(id))
+			freeBits[id >> 5] &= ~(1 << (id & 0x1F));
+		if (id >= nextID)
+			nextID = id + 1;
+	}
+
+	void Release(UInt32 id)
+	{
+		if (!id || IsFree(id))
+			return;
+		if ((id >> 5) >= freeBits.size())
+			freeBits.resize((id >> 5) + 1);
+		freeBits[id >> 5] |= 1 << (id & 0x1F);
+		freeList.push_back(id);
+		if (id >= nextID)
+			nextID = id + 1;
+	}
+
+	void SetTemporary(UInt32 id, bool bTemporary)
+	{
+		if (bTemporary)
+		{
+			if (id >= tempIndex.size())
+				tempIndex.resize(id + 1);
+			if (tempIndex[id])
+				return;
+			temps.push_back(id);
+			tempIndex[id] = temps.size();
+		}
+		else if (IsTemporary(id))
+		{
+			const UInt32 last = temps.back();
+			temps[tempIndex[id] - 1] = last;
+			tempIndex[last] = tempIndex[id];
+			temps.pop_back();
+			tempIndex[id] = 0;
+		}
+	}
+
+	bool IsTemporary(UInt32 id) const { return id < tempIndex.size() && tempIndex[id]; }
+	bool HasTemporary() const { return !temps.empty(); }
+	UInt32 LastTemporary() const { return temps.back(); }
+
+	void Clear()
+	{
+		freeList.clear();
+		freeBits.clear();
+		temps.clear();
+		tempIndex.clear();
+		nextID = 1;
+	}
+};
@@ -1,21 +1,17 @@
 #pragma once
+#include <atomic>
+#include <cstdio>
+#include <vector>
 
 #include "Serialization.h"
+#include "VarIDAllocator.h"
+#include "VarMapCache.h"
 
-// simple template class used to support NVSE custom data types (strings, arrays, etc)
+// 1 writes every lookup and delete of every VarMap to VarLookups.txt in the working directory, one per line as
+// "<map> <thread ID> G|D <var ID>", to replay them with benchmarks/var_cache_bench
+#define TRACE_VAR_LOOKUPS 0
 
-struct _VarIDs : Set<UInt32>
-{
-	UInt32 PopFirst()
-	{
-		UInt32 *keys = Keys(), first = *keys;
-		if (--numKeys)
-			memmove(keys, keys + 1, numKeys * 4);
-		return first;
-	}
-
-	UInt32 LastKey() {return Keys()[numKeys - 1];}
-};
+// simple template class used to support NVSE custom data types (strings, arrays, etc)
 
 template <class Var>
 class VarMap
@@ -26,75 +22,55 @@ protected:
 #else
 	typedef UnorderedMap<UInt32, Var> _VarMap;
 #endif
-	class VarCache
-	{
-		// if desired this can be replaced with an impl that caches more than one var without changing client code
-		UInt32		varID;
-		Var			* var;
-
-	public:
-		VarCache() : varID(0), var(NULL) {}
-
-		~VarCache()
-		{ 
-			Reset(); 
-		}
-
-		void Insert(UInt32 id, Var* v)
-		{
-			varID = id;
-			var = v;
-		}
+	typedef VarCacheStats CacheStats;
+	typedef VarMapCache<Var> VarCache;
 
-		// clear all cached vars (only one in current impl)
-		void Reset()
-		{
-			varID = 0;
-			var = NULL;
-		}
+	_VarMap				vars;
+	VarIDAllocator		ids;			// temporary IDs are those of unreferenced vars, makes for easy cleanup
+	std::atomic<UInt32>	generation = 0;
+	std::vector<VarCache*>	caches;		// of every thread that looked up a var, for the stats
+	CRITICAL_SECTION	cs;				// trying to avoid what looks like concurrency issues
 
-		void Remove(UInt32 id)
+	VarCache& GetCache()
+	{
+		// heap allocated so that the stats of threads that exited can still be read
+		thread_local VarCache* cache = NULL;
+		if (!cache)
 		{
-			if (id == varID)
-			{
-				Reset();
-			}
+			cache = new VarCache();
+			::EnterCriticalSection(&cs);
+			caches.push_back(cache);
+			::LeaveCriticalSection(&cs);
 		}
+		if (!cache->Validate(this, generation.load(std::memory_order_acquire)))
+			CacheStats::Add(cache->stats.drops);
+		return *cache;
+	}
 
-		Var* Get(UInt32 id)
-		{
-			return (varID == id) ? var : NULL;
-		}
-	};
+#if TRACE_VAR_LOOKUPS
+	void Trace(char op, UInt32 varID) const
+	{
+		static FILE* trace = fopen("VarLookups.txt", "w");
+		if (trace)
+			fprintf(trace, "%p %lu %c %lu\n", this, GetCurrentThreadId(), op, varID);
+	}
+#endif
 
-	_VarMap				vars;
-	_VarIDs				usedIDs;
-	_VarIDs				tempIDs;		// set of IDs of unreferenced vars, makes for easy cleanup
-	_VarIDs				availableIDs;	// IDs < greatest used ID available as IDs for new vars
-	VarCache			cache;
-	CRITICAL_SECTION	cs;				// trying to avoid what looks like concurrency issues
+	void InvalidateCaches()
+	{
+		generation.fetch_add(1, std::memory_order_release);
+	}
 
 
 	void SetIDAvailable(UInt32 id)
 	{
-		if (id) availableIDs.Insert(id);
+		ids.Release(id);
 	}
 
 	UInt32 GetUnusedID()
 	{
-		UInt32 id = 1;
 		::EnterCriticalSection(&cs);
-		int debug = 0;
-		if (!availableIDs.Empty())
-		{
-			debug = 1;
-			id = availableIDs.PopFirst();
-		}
-		else if (!usedIDs.Empty())
-		{
-			debug = 2;
-			id = usedIDs.LastKey() + 1;
-		}
+		UInt32 id = ids.Allocate();
 		::LeaveCriticalSection(&cs);
 		return id;
 	}
@@ -108,19 +84,28 @@ public:
 	~VarMap()
 	{
 		Reset();
+		for (auto* cache : caches)
+			delete cache;
 		::DeleteCriticalSection(&cs);
 	}
 
 	Var* Get(UInt32 varID)
 	{
 		if (!varID) return NULL;
+#if TRACE_VAR_LOOKUPS
+		Trace('G', varID);
+#endif
+		VarCache& cache = GetCache();
 		Var* var = cache.Get(varID);
-		if (!var)
+		if (var)
 		{
-			var = vars.GetPtr(varID);
-			if (var)
-				cache.Insert(varID, var);
+			CacheStats::Add(cache.stats.hits);
+			return var;
 		}
+		CacheStats::Add(cache.stats.misses);
+		var = vars.GetPtr(varID);
+		if (var)
+			cache.Insert(varID, var);
 		return var;
 	}
 
@@ -133,8 +118,11 @@ public:
 	Var* Insert(UInt32 varID, Args&& ...args)
 	{
 		::EnterCriticalSection(&cs);
-		usedIDs.Insert(varID);
+		ids.Claim(varID);
 		Var* var = vars.Emplace(varID, std::forward<Args>(args)...);
+#if _DEBUG
+		InvalidateCaches();
+#endif
 		::LeaveCriticalSection(&cs);
 		return var;
 	}
@@ -142,11 +130,13 @@ public:
 	void Delete(UInt32 varID)
 	{
 		::EnterCriticalSection(&cs);
-		cache.Remove(varID);
+#if TRACE_VAR_LOOKUPS
+		Trace('D', varID);
+#endif
+		InvalidateCaches();
 		vars.Erase(varID);
-		usedIDs.Erase(varID);
-		tempIDs.Erase(varID);
-		SetIDAvailable(varID);
+		ids.SetTemporary(varID, false);
+		ids.Release(varID);
 		::LeaveCriticalSection(&cs);
 	}
 
@@ -158,7 +148,7 @@ public:
 
 	void Reset()
 	{
-		cache.Reset();
+		InvalidateCaches();
 
 		_VarMap::Iterator iter;
 		while (true)
@@ -168,9 +158,7 @@ public:
 			iter.Remove();
 		}
 
-		usedIDs.Clear();
-		tempIDs.Clear();
-		availableIDs.Clear();
+		ids.Clear();
 	}
 
 #if _DEBUG
@@ -187,7 +175,7 @@ public:
 				//debugInfos[varID] = GetCallStack(12);
 			}
 #endif
-			tempIDs.Insert(varID);
+			ids.SetTemporary(varID, true);
 		}
 		else
 		{
@@ -197,12 +185,39 @@ public:
 				//debugInfos.erase(varID);
 			}
 #endif
-			tempIDs.Erase(varID);
+			ids.SetTemporary(varID, false);
 		}
 	}
 
 	bool IsTemporary(UInt32 varID)
 	{
-		return tempIDs.HasKey(varID);
+		return ids.IsTemporary(varID);
+	}
+
+	// lookups answered by the caches of Get, lookups that went to the map and times a thread's cache was dropped
+	void GetCacheStats(UInt32& hits, UInt32& misses, UInt32& drops)
+	{
+		hits = misses = drops = 0;
+		::EnterCriticalSection(&cs);
+		for (auto* cache : caches)
+		{
+			hits += cache->stats.hits.load(std::memory_order_relaxed);
+			misses += cache->stats.misses.load(std::memory_order_relaxed);
+			drops += cache->stats.drops.load(std::memory_order_relaxed);
+		}
+		::LeaveCriticalSection(&cs);
+	}
+
+	// approximate, a thread counting at the same time may store its old count back
+	void ResetCacheStats()
+	{
+		::EnterCriticalSection(&cs);
+		for (auto* cache : caches)
+		{
+			cache->stats.hits = 0;
+			cache->stats.misses = 0;
+			cache->stats.drops = 0;
+		}
+		::LeaveCriticalSection(&cs);
 	}
 };
\ No newline at end of file
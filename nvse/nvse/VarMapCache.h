@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Lookup counters of one thread. Only that thread counts, so they stay in its own cache lines;
+// VarMap::GetCacheStats sums the counters of all threads.
+struct VarCacheStats
+{
+	std::atomic<UInt32>	hits = 0;
+	std::atomic<UInt32>	misses = 0;
+	std::atomic<UInt32>	drops = 0;
+
+	// single writer, no locked add needed
+	static void Add(std::atomic<UInt32>& counter)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+};
+
+// The vars a thread looked up last in a VarMap, fully associative with round robin replacement. A thread's
+// cache is dropped when the generation of its map changed, which deleting vars advances (and inserting them in
+// debug builds, where the map moves its values). Line aligned so that no two threads' caches share one.
+template <class Var, UInt32 NumEntries = 8>
+class alignas(64) VarMapCache
+{
+public:
+	static constexpr UInt32 kNumEntries = NumEntries;
+
+	VarCacheStats	stats;
+
+private:
+	struct Entry
+	{
+		UInt32	varID;
+		Var		* var;
+	};
+
+	Entry			entries[kNumEntries] = {};
+	const void		* owner = NULL;
+	UInt32			generation = 0;
+	UInt32			next = 0;
+
+public:
+	// false if the cache was dropped
+	bool Validate(const void* map, UInt32 mapGeneration)
+	{
+		if (owner == map && generation == mapGeneration)
+			return true;
+		Reset();
+		owner = map;
+		generation = mapGeneration;
+		return false;
+	}
+
+	void Insert(UInt32 id, Var* v)
+	{
+		entries[next] = Entry{id, v};
+		next = (next + 1) % kNumEntries;
+	}
+
+	void Reset()
+	{
+		for (auto& entry : entries)
+			entry = Entry{0, NULL};
+		next = 0;
+	}
+
+	Var* Get(UInt32 id)
+	{
+		for (auto& entry : entries)
+		{
+			if (entry.varID == id)
+				return entry.var;
+		}
+		return NULL;
+	}
+};
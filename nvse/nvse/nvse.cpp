@@ -14,6 +14,8 @@
 #include "Commands_Input.h"
 #include "GameAPI.h"
 #include "EventManager.h"
+#include "ScriptTokens.h"
+#include "ExpressionDiskCache.h"
 
 #if RUNTIME
 IDebugLog	gLog("nvse.log");
@@ -121,6 +123,8 @@ void NVSE_Initialize(void)
 		Hook_Animation_Init();
 		OtherHooks::Hooks_Other_Init();
 		EventManager::Init();
+		Operator::InitDispatchTables();
+		ExpressionDiskCache::Init();
 
 		Hook_Dialog_Init();
 #endif
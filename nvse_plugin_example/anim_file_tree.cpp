@@ -0,0 +1,317 @@
+#include "anim_file_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "utility.h"
+
+AnimFileTree g_animFileTree;
+
+namespace
+{
+	constexpr UInt32 kManifestMagic = 0x4D414E4B; // KNAM
+	constexpr UInt32 kManifestVersion = 1;
+
+	std::string GetKey(const std::string& path)
+	{
+		auto key = path;
+		std::transform(key.begin(), key.end(), key.begin(), [](char c) { return c == '/' ? '\\' : static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+		while (!key.empty() && key.back() == '\\')
+			key.pop_back();
+		return key;
+	}
+
+	bool LessCI(const std::string& a, const std::string& b)
+	{
+		return _stricmp(a.c_str(), b.c_str()) < 0;
+	}
+
+	bool HasExtension(const std::string& name, const char* extension)
+	{
+		const auto len = strlen(extension);
+		return name.size() >= len && _stricmp(name.c_str() + name.size() - len, extension) == 0;
+	}
+
+	SInt64 GetMTime(const std::filesystem::path& path, std::error_code& ec)
+	{
+		return std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+	}
+
+	using ManifestMap = std::unordered_map<std::string, AnimFileTree::Directory>;
+
+	// fills out with the contents of relPath, taken from the manifest if the folder did not change since
+	bool ReadDirectory(const std::string& meshesDir, const std::string& relPath, const ManifestMap& manifest, AnimFileTree::Directory& out, bool& changed)
+	{
+		std::error_code ec;
+		const std::filesystem::path fullPath = meshesDir + relPath;
+		const auto mtime = GetMTime(fullPath, ec);
+		if (ec)
+			return false;
+		const auto cached = manifest.find(GetKey(relPath));
+		if (cached != manifest.end() && cached->second.mtime == mtime)
+		{
+			out = cached->second;
+			out.path = relPath;
+			return true;
+		}
+		changed = true;
+		out.path = relPath;
+		out.mtime = mtime;
+		for (std::filesystem::directory_iterator iter(fullPath, ec), end; !ec && iter != end; iter.increment(ec))
+		{
+			std::error_code entryEc;
+			auto name = iter->path().filename().string();
+			if (iter->is_directory(entryEc))
+			{
+				out.subdirs.push_back(std::move(name));
+				continue;
+			}
+			if (!HasExtension(name, ".kf"))
+				continue;
+			AnimFileTree::File file{std::move(name), GetMTime(iter->path(), entryEc), iter->file_size(entryEc), -1};
+			if (cached != manifest.end())
+			{
+				// the folder changed but this file may not have, keep its resolved group
+				const auto& oldFiles = cached->second.files;
+				const auto old = std::lower_bound(oldFiles.begin(), oldFiles.end(), file.name, [](const AnimFileTree::File& f, const std::string& n) { return LessCI(f.name, n); });
+				if (old != oldFiles.end() && _stricmp(old->name.c_str(), file.name.c_str()) == 0 && old->mtime == file.mtime && old->size == file.size)
+					file.groupId = old->groupId;
+			}
+			out.files.push_back(std::move(file));
+		}
+		std::sort(out.subdirs.begin(), out.subdirs.end(), LessCI);
+		std::sort(out.files.begin(), out.files.end(), [](const AnimFileTree::File& a, const AnimFileTree::File& b) { return LessCI(a.name, b.name); });
+		return true;
+	}
+
+	void WalkDirectory(const std::string& meshesDir, const std::string& relPath, const ManifestMap& manifest, std::vector<AnimFileTree::Directory>& out, bool& changed)
+	{
+		AnimFileTree::Directory dir;
+		if (!ReadDirectory(meshesDir, relPath, manifest, dir, changed))
+			return;
+		const auto subdirs = dir.subdirs;
+		out.push_back(std::move(dir));
+		for (const auto& subdir : subdirs)
+			WalkDirectory(meshesDir, relPath + '\\' + subdir, manifest, out, changed);
+	}
+
+	template <typename T>
+	void Write(std::ofstream& os, const T& value)
+	{
+		os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void WriteString(std::ofstream& os, const std::string& str)
+	{
+		Write<UInt16>(os, str.size());
+		os.write(str.data(), str.size());
+	}
+
+	template <typename T>
+	T Read(std::ifstream& is)
+	{
+		T value{};
+		is.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return value;
+	}
+
+	std::string ReadString(std::ifstream& is)
+	{
+		std::string str(Read<UInt16>(is), '\0');
+		is.read(str.data(), str.size());
+		return str;
+	}
+}
+
+std::string GetAnimManifestPath()
+{
+	return GetCurPath() + R"(\Data\NVSE\Plugins\kNVSE_anim_manifest.bin)";
+}
+
+void AnimFileTree::LoadManifest(const std::string& manifestPath, std::unordered_map<std::string, Directory>& out) const
+{
+	std::ifstream is(manifestPath, std::ios::binary);
+	if (!is || Read<UInt32>(is) != kManifestMagic || Read<UInt32>(is) != kManifestVersion)
+		return;
+	for (auto numDirs = Read<UInt32>(is); numDirs && is; --numDirs)
+	{
+		Directory dir;
+		dir.path = ReadString(is);
+		dir.mtime = Read<SInt64>(is);
+		for (auto numSubdirs = Read<UInt32>(is); numSubdirs && is; --numSubdirs)
+			dir.subdirs.push_back(ReadString(is));
+		for (auto numFiles = Read<UInt32>(is); numFiles && is; --numFiles)
+		{
+			File file;
+			file.name = ReadString(is);
+			file.mtime = Read<SInt64>(is);
+			file.size = Read<UInt64>(is);
+			file.groupId = Read<SInt32>(is);
+			dir.files.push_back(std::move(file));
+		}
+		out.emplace(GetKey(dir.path), std::move(dir));
+	}
+	if (!is)
+	{
+		Log("Animation manifest is corrupted, rescanning all folders");
+		out.clear();
+	}
+}
+
+void AnimFileTree::SaveManifest(const std::string& manifestPath)
+{
+	if (!dirty_)
+		return;
+	std::ofstream os(manifestPath, std::ios::binary | std::ios::trunc);
+	if (!os)
+	{
+		Log("Failed to write animation manifest " + manifestPath);
+		return;
+	}
+	Write(os, kManifestMagic);
+	Write(os, kManifestVersion);
+	Write<UInt32>(os, dirs_.size());
+	for (const auto& [key, dir] : dirs_)
+	{
+		WriteString(os, dir.path);
+		Write(os, dir.mtime);
+		Write<UInt32>(os, dir.subdirs.size());
+		for (const auto& subdir : dir.subdirs)
+			WriteString(os, subdir);
+		Write<UInt32>(os, dir.files.size());
+		for (const auto& file : dir.files)
+		{
+			WriteString(os, file.name);
+			Write(os, file.mtime);
+			Write(os, file.size);
+			Write<SInt32>(os, file.groupId);
+		}
+	}
+	dirty_ = false;
+}
+
+void AnimFileTree::Scan(const std::string& root, const std::string& manifestPath)
+{
+	ManifestMap manifest;
+	LoadManifest(manifestPath, manifest);
+	dirs_.clear();
+
+	const auto meshesDir = GetCurPath() + R"(\Data\Meshes\)";
+	Directory rootDir;
+	bool changed = false;
+	if (!ReadDirectory(meshesDir, root, manifest, rootDir, changed))
+		return;
+
+	// every top level folder (usually one per mod) is a unit of work
+	std::vector<std::vector<Directory>> results(rootDir.subdirs.size());
+	std::vector<char> resultsChanged(rootDir.subdirs.size(), 0);
+	std::atomic<UInt32> next{0};
+	const auto worker = [&]
+	{
+		for (UInt32 i; (i = next++) < rootDir.subdirs.size();)
+		{
+			bool dirChanged = false;
+			WalkDirectory(meshesDir, root + '\\' + rootDir.subdirs[i], manifest, results[i], dirChanged);
+			resultsChanged[i] = dirChanged;
+		}
+	};
+	const auto numThreads = std::min<UInt32>(std::max(std::thread::hardware_concurrency(), 1U), rootDir.subdirs.size());
+	std::vector<std::thread> threads;
+	for (UInt32 i = 1; i < numThreads; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+
+	dirs_.emplace(GetKey(root), std::move(rootDir));
+	for (UInt32 i = 0; i < results.size(); ++i)
+	{
+		changed |= resultsChanged[i] != 0;
+		for (auto& dir : results[i])
+		{
+			auto key = GetKey(dir.path);
+			dirs_.emplace(std::move(key), std::move(dir));
+		}
+	}
+	// folders that were deleted also need the manifest rewritten
+	dirty_ = changed || manifest.size() != dirs_.size();
+}
+
+void AnimFileTree::Clear()
+{
+	dirs_.clear();
+}
+
+const AnimFileTree::Directory* AnimFileTree::GetDirectory(const std::string& path) const
+{
+	const auto iter = dirs_.find(GetKey(path));
+	return iter != dirs_.end() ? &iter->second : nullptr;
+}
+
+std::vector<std::string> AnimFileTree::GetFilesRecursive(const std::string& path, const char* extension) const
+{
+	std::vector<std::string> result;
+	const auto walk = [&](const auto& self, const Directory& dir) -> void
+	{
+		for (const auto& file : dir.files)
+			if (HasExtension(file.name, extension))
+				result.push_back(dir.path + '\\' + file.name);
+		for (const auto& subdir : dir.subdirs)
+			if (const auto* child = GetDirectory(dir.path + '\\' + subdir))
+				self(self, *child);
+	};
+	if (const auto* dir = GetDirectory(path))
+		walk(walk, *dir);
+	return result;
+}
+
+AnimFileTree::File* AnimFileTree::FindFile(const std::string& path)
+{
+	const auto slash = path.find_last_of("\\/");
+	if (slash == std::string::npos)
+		return nullptr;
+	const auto iter = dirs_.find(GetKey(path.substr(0, slash)));
+	if (iter == dirs_.end())
+		return nullptr;
+	auto& files = iter->second.files;
+	const auto name = path.substr(slash + 1);
+	const auto file = std::lower_bound(files.begin(), files.end(), name, [](const File& f, const std::string& n) { return LessCI(f.name, n); });
+	if (file == files.end() || _stricmp(file->name.c_str(), name.c_str()) != 0)
+		return nullptr;
+	return &*file;
+}
+
+int AnimFileTree::GetGroupId(const std::string& path)
+{
+	auto* file = FindFile(path);
+	if (!file || file->groupId == -1)
+		return -1;
+	// overwriting a file does not touch the mtime of its folder, so an unchanged folder says nothing about the file
+	std::error_code mtimeEc, sizeEc;
+	const std::filesystem::path fullPath = GetCurPath() + R"(\Data\Meshes\)" + path;
+	const auto mtime = GetMTime(fullPath, mtimeEc);
+	const auto size = std::filesystem::file_size(fullPath, sizeEc);
+	if (mtimeEc || sizeEc)
+		return -1;
+	if (mtime != file->mtime || size != file->size)
+	{
+		file->mtime = mtime;
+		file->size = size;
+		file->groupId = -1;
+		dirty_ = true;
+		return -1;
+	}
+	return file->groupId;
+}
+
+void AnimFileTree::SetGroupId(const std::string& path, int groupId)
+{
+	if (auto* file = FindFile(path); file && file->groupId != groupId)
+	{
+		file->groupId = groupId;
+		dirty_ = true;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// In-memory snapshot of Data\Meshes\AnimGroupOverride. The tree is walked once per launch by a pool
+// of workers, one top level folder at a time, and persisted to a binary manifest together with the
+// anim group ID resolved for each KF. On the next launch folders whose modification time did not
+// change are taken from the manifest without being enumerated again.
+// Paths are relative to Data\Meshes and lookups are case insensitive.
+class AnimFileTree
+{
+public:
+	struct File
+	{
+		std::string name;
+		SInt64 mtime;
+		UInt64 size;
+		int groupId; // -1 if not resolved yet
+	};
+
+	struct Directory
+	{
+		std::string path;
+		SInt64 mtime;
+		std::vector<std::string> subdirs; // names, sorted
+		std::vector<File> files; // .kf only, sorted by name
+	};
+
+private:
+	std::unordered_map<std::string, Directory> dirs_; // key is lower case path
+	bool dirty_ = false;
+
+	void LoadManifest(const std::string& manifestPath, std::unordered_map<std::string, Directory>& out) const;
+	File* FindFile(const std::string& path);
+
+public:
+	// walks root (e.g. AnimGroupOverride), reusing unchanged folders from the manifest at manifestPath
+	void Scan(const std::string& root, const std::string& manifestPath);
+	void SaveManifest(const std::string& manifestPath);
+	void Clear();
+
+	const Directory* GetDirectory(const std::string& path) const;
+
+	// all files below path whose extension matches (e.g. ".kf"), depth first in name order
+	std::vector<std::string> GetFilesRecursive(const std::string& path, const char* extension) const;
+
+	int GetGroupId(const std::string& path);
+	void SetGroupId(const std::string& path, int groupId);
+
+	UInt32 NumDirectories() const { return dirs_.size(); }
+};
+
+extern AnimFileTree g_animFileTree;
+
+std::string GetAnimManifestPath();
@@ -0,0 +1,160 @@
+#include "anim_override_index.h"
+
+#include <algorithm>
+#include <utility>
+
+void AnimOverrideIndex::Rehash(UInt32 capacity)
+{
+	auto oldSlots = std::move(slots_);
+	slots_.assign(capacity, Slot{0, 0, 0});
+	mask_ = capacity - 1;
+	for (const auto& slot : oldSlots)
+	{
+		if (!slot.dist)
+			continue;
+		auto entry = Slot{slot.key, slot.stackIdx, 1};
+		auto idx = Hash(entry.key) & mask_;
+		while (true)
+		{
+			auto& dst = slots_[idx];
+			if (!dst.dist)
+			{
+				dst = entry;
+				break;
+			}
+			if (dst.dist < entry.dist)
+				std::swap(dst, entry);
+			++entry.dist;
+			idx = (idx + 1) & mask_;
+		}
+	}
+}
+
+UInt32 AnimOverrideIndex::Insert(UInt64 key)
+{
+	// keep load factor at or below 1/2 so that misses stay at a probe or two
+	if ((stacks_.size() + 1) * 2 > slots_.size())
+		Rehash(slots_.empty() ? 64 : slots_.size() * 2);
+
+	const UInt32 stackIdx = stacks_.size();
+	stacks_.emplace_back();
+	if ((key >> 8 & 0xFF) != static_cast<UInt32>(AnimCustom::None))
+		++numCustom_;
+
+	auto entry = Slot{key, stackIdx, 1};
+	auto idx = Hash(key) & mask_;
+	while (true)
+	{
+		auto& dst = slots_[idx];
+		if (!dst.dist)
+		{
+			dst = entry;
+			return stackIdx;
+		}
+		if (dst.dist < entry.dist)
+			std::swap(dst, entry);
+		++entry.dist;
+		idx = (idx + 1) & mask_;
+	}
+}
+
+AnimStack& AnimOverrideIndex::Get(UInt32 refId, UInt32 groupId, AnimCustom custom, bool firstPerson)
+{
+	const auto key = MakeAnimOverrideKey(refId, groupId, custom, firstPerson);
+	if (auto* stack = Find(key))
+		return *stack;
+	return stacks_[Insert(key)];
+}
+
+void AnimOverrideIndex::Reserve(UInt32 numKeys)
+{
+	stacks_.reserve(numKeys);
+	UInt32 capacity = slots_.empty() ? 64 : slots_.size();
+	while (numKeys * 2 > capacity)
+		capacity *= 2;
+	if (capacity != slots_.size())
+		Rehash(capacity);
+}
+
+void AnimOverrideIndex::Clear()
+{
+	slots_.clear();
+	stacks_.clear();
+	mask_ = 0;
+	numCustom_ = 0;
+}
+
+namespace
+{
+	constexpr UInt32 kUnassignedSlot = 0xFFFFFFFF;
+	constexpr UInt32 kOverflowSlot = 0xFFFFFFFE;
+
+	thread_local UInt32 t_readerSlot = kUnassignedSlot;
+	thread_local UInt32 t_readDepth = 0;
+}
+
+const AnimOverrideIndex* AnimOverrideSnapshots::BeginRead()
+{
+	if (t_readDepth++ == 0)
+	{
+		if (t_readerSlot == kUnassignedSlot)
+		{
+			const auto slot = numReaders_.fetch_add(1);
+			t_readerSlot = slot < kMaxReaders ? slot : kOverflowSlot;
+		}
+		// the announcement has to be visible before the snapshot is loaded, hence seq_cst on both
+		if (t_readerSlot != kOverflowSlot)
+			readers_[t_readerSlot].epoch.store(epoch_.load());
+		else
+			numOverflowReaders_.fetch_add(1);
+	}
+	return current_.load();
+}
+
+void AnimOverrideSnapshots::EndRead()
+{
+	if (--t_readDepth != 0)
+		return;
+	if (t_readerSlot != kOverflowSlot)
+		readers_[t_readerSlot].epoch.store(kQuiescent, std::memory_order_release);
+	else
+		numOverflowReaders_.fetch_sub(1, std::memory_order_release);
+}
+
+void AnimOverrideSnapshots::BeginWrite()
+{
+	if (writeDepth_++ == 0)
+		draft_ = std::make_unique<AnimOverrideIndex>(*current_.load());
+}
+
+void AnimOverrideSnapshots::EndWrite()
+{
+	if (--writeDepth_ != 0)
+		return;
+	const auto* old = current_.exchange(draft_.release());
+	// any reader still holding old announced an epoch no later than this one
+	retired_.push_back(Retired{old, epoch_.fetch_add(1)});
+	Reclaim();
+}
+
+void AnimOverrideSnapshots::Reclaim()
+{
+	if (numOverflowReaders_.load() != 0)
+		return;
+	UInt32 minEpoch = 0xFFFFFFFF;
+	const auto numReaders = std::min(numReaders_.load(), kMaxReaders);
+	for (UInt32 i = 0; i < numReaders; ++i)
+	{
+		const auto epoch = readers_[i].epoch.load();
+		if (epoch != kQuiescent && epoch < minEpoch)
+			minEpoch = epoch;
+	}
+	const auto iter = std::remove_if(retired_.begin(), retired_.end(), [&](const Retired& retired)
+	{
+		if (retired.epoch >= minEpoch)
+			return false;
+		delete retired.index;
+		return true;
+	});
+	retired_.erase(iter, retired_.end());
+}
@@ -0,0 +1,182 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "anim_variants.h"
+
+// Stack of variant groups, the top (back) of the stack is the active one
+using AnimStack = std::vector<SavedAnims>;
+
+// (refID, groupId, AnimCustom, firstPerson) packed into a single 64 bit key
+inline UInt64 MakeAnimOverrideKey(UInt32 refId, UInt32 groupId, AnimCustom custom, bool firstPerson)
+{
+	return (static_cast<UInt64>(refId) << 32) | ((groupId & 0xFFFF) << 16) | (static_cast<UInt32>(custom) << 8) | (firstPerson ? 1 : 0);
+}
+
+// Flat open-addressing (robin hood) index of animation overrides. All variant stacks live in one
+// contiguous array; slots only hold the key and an index into it. Lookups that miss end as soon as
+// the probe distance exceeds that of the slot being inspected, which for a sparse table is usually
+// the very first slot.
+class AnimOverrideIndex
+{
+	struct Slot
+	{
+		UInt64 key;
+		UInt32 stackIdx;
+		UInt32 dist; // probe distance + 1, 0 if empty
+	};
+
+	std::vector<Slot> slots_;
+	std::vector<AnimStack> stacks_;
+	UInt32 mask_ = 0;
+	UInt32 numCustom_ = 0;
+	// xorshift32 state of actors seeded with SetActorAnimationSeed. The state is shared by every snapshot
+	// taken after the seed was set and advanced atomically by the readers.
+	std::unordered_map<UInt32, std::shared_ptr<std::atomic<UInt32>>> actorRngs_;
+
+	static UInt32 Hash(UInt64 key)
+	{
+		key ^= key >> 33;
+		key *= 0xFF51AFD7ED558CCDULL;
+		key ^= key >> 33;
+		key *= 0xC4CEB9FE1A85EC53ULL;
+		key ^= key >> 33;
+		return static_cast<UInt32>(key);
+	}
+
+	void Rehash(UInt32 capacity);
+	UInt32 Insert(UInt64 key);
+
+public:
+	const AnimStack* Find(UInt64 key) const
+	{
+		if (slots_.empty())
+			return nullptr;
+		auto idx = Hash(key) & mask_;
+		for (UInt32 dist = 1; ; ++dist)
+		{
+			const auto& slot = slots_[idx];
+			if (slot.dist < dist)
+				return nullptr;
+			if (slot.key == key)
+				return &stacks_[slot.stackIdx];
+			idx = (idx + 1) & mask_;
+		}
+	}
+
+	AnimStack* Find(UInt64 key)
+	{
+		return const_cast<AnimStack*>(std::as_const(*this).Find(key));
+	}
+
+	const AnimStack* Find(UInt32 refId, UInt32 groupId, AnimCustom custom, bool firstPerson) const
+	{
+		return Find(MakeAnimOverrideKey(refId, groupId, custom, firstPerson));
+	}
+
+	// find or create
+	AnimStack& Get(UInt32 refId, UInt32 groupId, AnimCustom custom, bool firstPerson);
+
+	// pre-size for numKeys entries without further rehashing
+	void Reserve(UInt32 numKeys);
+	void Clear();
+
+	UInt32 Size() const { return stacks_.size(); }
+
+	// nullptr if the actor was never seeded
+	std::atomic<UInt32>* FindActorRng(UInt32 refId) const
+	{
+		const auto iter = actorRngs_.find(refId);
+		return iter != actorRngs_.end() ? iter->second.get() : nullptr;
+	}
+
+	// starts a new sequence, readers of older snapshots keep advancing the previous one
+	void SeedActorRng(UInt32 refId, UInt32 seed)
+	{
+		actorRngs_[refId] = std::make_shared<std::atomic<UInt32>>(XorShift32(seed).state);
+	}
+
+	// true if any male/female/hurt conditioned stack was ever registered, used to skip classifying the previous sequence
+	bool HasCustomStacks() const { return numCustom_ != 0; }
+};
+
+// Publishes the override index to the animation hooks as immutable snapshots. Readers never lock: they
+// announce the current epoch, load the snapshot pointer and clear the announcement when done. Writers
+// are serialised by a mutex, edit a private copy of the current snapshot and swap it in when the
+// outermost Writer goes out of scope, so a batch of edits costs one copy and one publish. A replaced
+// snapshot is freed once no reader announced an epoch at or before the one it was retired in.
+// Reader state is thread local, there must only be one instance.
+class AnimOverrideSnapshots
+{
+	static constexpr UInt32 kMaxReaders = 32;
+	static constexpr UInt32 kQuiescent = 0;
+
+	struct alignas(64) ReaderSlot
+	{
+		std::atomic<UInt32> epoch{kQuiescent};
+	};
+
+	struct Retired
+	{
+		const AnimOverrideIndex* index;
+		UInt32 epoch;
+	};
+
+	std::atomic<const AnimOverrideIndex*> current_;
+	std::atomic<UInt32> epoch_{1};
+	ReaderSlot readers_[kMaxReaders];
+	std::atomic<UInt32> numReaders_{0};
+	std::atomic<UInt32> numOverflowReaders_{0}; // threads past kMaxReaders, nothing is freed while one is inside
+
+	std::recursive_mutex writeMutex_;
+	std::unique_ptr<AnimOverrideIndex> draft_;
+	UInt32 writeDepth_ = 0;
+	std::vector<Retired> retired_;
+
+	const AnimOverrideIndex* BeginRead();
+	void EndRead();
+	void BeginWrite();
+	void EndWrite();
+	void Reclaim();
+
+public:
+	AnimOverrideSnapshots() : current_(new AnimOverrideIndex()) {}
+	AnimOverrideSnapshots(const AnimOverrideSnapshots&) = delete;
+	AnimOverrideSnapshots& operator=(const AnimOverrideSnapshots&) = delete;
+
+	// wait free, the snapshot stays valid for the lifetime of the reader
+	class Reader
+	{
+		AnimOverrideSnapshots& owner_;
+		const AnimOverrideIndex* index_;
+
+	public:
+		explicit Reader(AnimOverrideSnapshots& owner) : owner_(owner), index_(owner.BeginRead()) {}
+		~Reader() { owner_.EndRead(); }
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		const AnimOverrideIndex& operator*() const { return *index_; }
+		const AnimOverrideIndex* operator->() const { return index_; }
+	};
+
+	// writers nest on the same thread, only the outermost one publishes
+	class Writer
+	{
+		AnimOverrideSnapshots& owner_;
+		std::lock_guard<std::recursive_mutex> lock_;
+
+	public:
+		explicit Writer(AnimOverrideSnapshots& owner) : owner_(owner), lock_(owner.writeMutex_) { owner_.BeginWrite(); }
+		~Writer() { owner_.EndWrite(); }
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		AnimOverrideIndex& operator*() const { return *owner_.draft_; }
+		AnimOverrideIndex* operator->() const { return owner_.draft_.get(); }
+	};
+};
@@ -0,0 +1,127 @@
+#include "anim_path_pool.h"
+
+AnimPathPool g_animPathPool;
+
+namespace
+{
+	char FoldChar(char c)
+	{
+		if (c == '/')
+			return '\\';
+		if (c >= 'A' && c <= 'Z')
+			return c + ('a' - 'A');
+		return c;
+	}
+
+	bool EqualsFolded(const char* a, const char* b)
+	{
+		for (; *a && *b; ++a, ++b)
+			if (FoldChar(*a) != FoldChar(*b))
+				return false;
+		return *a == *b;
+	}
+
+	// case insensitive compare of a folder name followed by a separator
+	bool MatchFolder(const char* str, const char* folder)
+	{
+		for (; *folder; ++str, ++folder)
+			if (FoldChar(*str) != *folder)
+				return false;
+		return FoldChar(*str) == '\\';
+	}
+}
+
+AnimCustom GetAnimCustom(const char* path)
+{
+	// single pass, but male takes precedence over female over hurt as if each was searched for separately
+	auto result = AnimCustom::None;
+	for (const auto* iter = path; *iter; ++iter)
+	{
+		if (FoldChar(*iter) != '\\')
+			continue;
+		if (MatchFolder(iter + 1, "male"))
+			return AnimCustom::Male;
+		if (MatchFolder(iter + 1, "female"))
+			result = AnimCustom::Female;
+		else if (result == AnimCustom::None && MatchFolder(iter + 1, "hurt"))
+			result = AnimCustom::Hurt;
+	}
+	return result;
+}
+
+UInt32 AnimPathPool::Hash(const char* path)
+{
+	// FNV-1a over the folded characters
+	UInt32 hash = 0x811C9DC5;
+	for (; *path; ++path)
+	{
+		hash ^= static_cast<UInt8>(FoldChar(*path));
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+AnimPathPool::~AnimPathPool()
+{
+	for (auto& chunk : chunks_)
+		delete[] chunk.load();
+}
+
+PathId AnimPathPool::Find(const char* path) const
+{
+	const auto hash = Hash(path);
+	std::lock_guard lock(writeMutex_);
+	return FindLocked(path, hash);
+}
+
+PathId AnimPathPool::FindLocked(const char* path, UInt32 hash) const
+{
+	if (table_.empty())
+		return kInvalidPathId;
+	for (auto idx = hash & mask_; ; idx = (idx + 1) & mask_)
+	{
+		const auto id = table_[idx];
+		if (id == kInvalidPathId)
+			return kInvalidPathId;
+		const auto& entry = GetEntry(id);
+		if (entry.hash == hash && EqualsFolded(entry.path.c_str(), path))
+			return id;
+	}
+}
+
+void AnimPathPool::Grow()
+{
+	const UInt32 capacity = table_.empty() ? 256 : table_.size() * 2;
+	table_.assign(capacity, kInvalidPathId);
+	mask_ = capacity - 1;
+	for (PathId id = 0, size = size_.load(); id < size; ++id)
+	{
+		auto idx = GetEntry(id).hash & mask_;
+		while (table_[idx] != kInvalidPathId)
+			idx = (idx + 1) & mask_;
+		table_[idx] = id;
+	}
+}
+
+PathId AnimPathPool::Intern(const char* path)
+{
+	const auto hash = Hash(path);
+	std::lock_guard lock(writeMutex_);
+	if (const auto id = FindLocked(path, hash); id != kInvalidPathId)
+		return id;
+	const PathId id = size_.load(std::memory_order_relaxed);
+	if (id == kChunkSize * kMaxChunks)
+		return kInvalidPathId;
+	if ((id + 1) * 2 > table_.size())
+		Grow();
+	auto& chunk = chunks_[id >> kChunkBits];
+	if (!chunk.load(std::memory_order_relaxed))
+		chunk.store(new Entry[kChunkSize], std::memory_order_release);
+	chunk.load(std::memory_order_relaxed)[id & (kChunkSize - 1)] = Entry{path, hash, GetAnimCustom(path)};
+	size_.store(id + 1, std::memory_order_release);
+	auto idx = hash & mask_;
+	while (table_[idx] != kInvalidPathId)
+		idx = (idx + 1) & mask_;
+	table_[idx] = id;
+	return id;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class AnimCustom
+{
+	None, Male, Female, Hurt
+};
+
+using PathId = UInt32;
+constexpr PathId kInvalidPathId = 0xFFFFFFFF;
+
+// Interned animation paths. Each path is stored once together with its case folded hash and its
+// AnimCustom classification so that comparing, hashing and classifying a path afterwards is a lookup.
+// Paths compare case insensitively and treat '/' and '\' as the same character.
+// The pool is append only. Entries live in fixed size chunks that never move, and a chunk is published
+// in the chunk table before any ID inside it is handed out, so the animation hooks read paths by ID
+// without locking while scripts intern new ones. Interning and Find are serialised by a mutex.
+class AnimPathPool
+{
+	struct Entry
+	{
+		std::string path;
+		UInt32 hash;
+		AnimCustom custom;
+	};
+
+	static constexpr UInt32 kChunkBits = 10;
+	static constexpr UInt32 kChunkSize = 1 << kChunkBits;
+	static constexpr UInt32 kMaxChunks = 4096;
+
+	std::atomic<Entry*> chunks_[kMaxChunks] = {};
+	std::atomic<UInt32> size_{0};
+	std::vector<PathId> table_; // open addressing, kInvalidPathId if empty, only touched under writeMutex_
+	UInt32 mask_ = 0;
+	mutable std::mutex writeMutex_;
+
+	void Grow();
+	PathId FindLocked(const char* path, UInt32 hash) const;
+	const Entry& GetEntry(PathId id) const
+	{
+		return chunks_[id >> kChunkBits].load(std::memory_order_acquire)[id & (kChunkSize - 1)];
+	}
+
+public:
+	AnimPathPool() = default;
+	AnimPathPool(const AnimPathPool&) = delete;
+	AnimPathPool& operator=(const AnimPathPool&) = delete;
+	~AnimPathPool();
+
+	static UInt32 Hash(const char* path);
+
+	// returns kInvalidPathId if the path was never interned
+	PathId Find(const char* path) const;
+	// kInvalidPathId once the chunk table is full
+	PathId Intern(const char* path);
+	PathId Intern(const std::string& path) { return Intern(path.c_str()); }
+
+	const std::string& GetPath(PathId id) const { return GetEntry(id).path; }
+	UInt32 GetHash(PathId id) const { return GetEntry(id).hash; }
+	AnimCustom GetCustom(PathId id) const { return GetEntry(id).custom; }
+
+	UInt32 Size() const { return size_.load(std::memory_order_acquire); }
+};
+
+extern AnimPathPool g_animPathPool;
+
+// male/female/hurt conditioned animations live in a folder of that name
+AnimCustom GetAnimCustom(const char* path);
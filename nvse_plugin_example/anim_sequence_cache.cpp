@@ -0,0 +1,98 @@
+#include "anim_sequence_cache.h"
+
+#include "GameRTTI.h"
+#include "NiNodes.h"
+#include "SafeWrite.h"
+#include "utility.h"
+
+AnimSequenceCache g_animSequenceCache;
+
+namespace
+{
+	using SequenceDestructor = void(__thiscall*)(BSAnimGroupSequence*, bool);
+	SequenceDestructor s_sequenceDestructor = nullptr;
+
+	void __fastcall SequenceDestructorHook(BSAnimGroupSequence* sequence, void* edx, bool freeThis)
+	{
+		g_animSequenceCache.Invalidate(sequence);
+		s_sequenceDestructor(sequence, freeThis);
+	}
+
+	// MSVC stores a pointer to the complete object locator of a class right before each of its vtables.
+	// The locator of the primary vtable has a zero offset and points at the class's type descriptor,
+	// which GameRTTI knows, so the vtable can be found in .rdata without hard coding its address.
+	struct CompleteObjectLocator
+	{
+		UInt32 signature;
+		UInt32 offset;
+		UInt32 cdOffset;
+		const void* typeDescriptor;
+		const void* classDescriptor;
+	};
+
+	UInt32* FindPrimaryVtable(const void* typeDescriptor)
+	{
+		auto* base = reinterpret_cast<UInt8*>(GetModuleHandle(nullptr));
+		const auto* ntHeaders = reinterpret_cast<IMAGE_NT_HEADERS*>(base + reinterpret_cast<IMAGE_DOS_HEADER*>(base)->e_lfanew);
+		const auto* section = IMAGE_FIRST_SECTION(ntHeaders);
+		for (UInt32 i = 0; i < ntHeaders->FileHeader.NumberOfSections; ++i, ++section)
+		{
+			if (strncmp(reinterpret_cast<const char*>(section->Name), ".rdata", IMAGE_SIZEOF_SHORT_NAME) != 0)
+				continue;
+			auto* begin = reinterpret_cast<UInt32*>(base + section->VirtualAddress);
+			auto* end = begin + section->Misc.VirtualSize / sizeof(UInt32);
+			const CompleteObjectLocator* locator = nullptr;
+			for (auto* iter = begin; iter + sizeof(CompleteObjectLocator) / sizeof(UInt32) <= end && !locator; ++iter)
+			{
+				const auto* candidate = reinterpret_cast<const CompleteObjectLocator*>(iter);
+				if (candidate->typeDescriptor == typeDescriptor && !candidate->signature && !candidate->offset)
+					locator = candidate;
+			}
+			if (!locator)
+				return nullptr;
+			for (auto* iter = begin; iter + 1 < end; ++iter)
+			{
+				if (*iter == reinterpret_cast<UInt32>(locator))
+					return iter + 1;
+			}
+			return nullptr;
+		}
+		return nullptr;
+	}
+}
+
+void ApplySequenceCacheHooks()
+{
+	auto* vtbl = FindPrimaryVtable(RTTI_BSAnimGroupSequence);
+	if (!vtbl)
+	{
+		// without the hook entries could outlive their sequence, so the cache stays off
+		Log("BSAnimGroupSequence vtable not found, previous sequences are classified on every morph");
+		return;
+	}
+	s_sequenceDestructor = reinterpret_cast<SequenceDestructor>(vtbl[0]);
+	SafeWrite32(reinterpret_cast<UInt32>(&vtbl[0]), reinterpret_cast<UInt32>(SequenceDestructorHook));
+}
+
+AnimCustom AnimSequenceCache::Get(BSAnimGroupSequence* sequence)
+{
+	if (!s_sequenceDestructor)
+		return sequence->sequenceName ? GetAnimCustom(sequence->sequenceName) : AnimCustom::None;
+	auto& entry = entries_[GetIndex(sequence)];
+	const auto key = static_cast<UInt64>(reinterpret_cast<UInt32>(sequence)) << 32;
+	const auto cached = entry.load(std::memory_order_acquire);
+	if ((cached & 0xFFFFFFFF00000000ULL) == key)
+		return static_cast<AnimCustom>(cached & 0xFFFFFFFF);
+
+	const auto custom = sequence->sequenceName ? GetAnimCustom(sequence->sequenceName) : AnimCustom::None;
+	entry.store(key | static_cast<UInt32>(custom), std::memory_order_release);
+	return custom;
+}
+
+void AnimSequenceCache::Invalidate(BSAnimGroupSequence* sequence)
+{
+	auto& entry = entries_[GetIndex(sequence)];
+	auto cached = entry.load(std::memory_order_acquire);
+	if ((cached >> 32) == reinterpret_cast<UInt32>(sequence))
+		entry.compare_exchange_strong(cached, 0, std::memory_order_acq_rel);
+}
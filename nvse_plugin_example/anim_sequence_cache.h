@@ -0,0 +1,32 @@
+#pragma once
+#include <atomic>
+
+#include "anim_path_pool.h"
+
+class BSAnimGroupSequence;
+
+// Remembers the AnimCustom classification of the sequences actors morph away from so that
+// GetActorAnimation does not have to look at the sequence name on every animation change.
+// The table is direct mapped and lock free; a collision simply replaces the older entry.
+// Entries are dropped when their sequence is destroyed, through a hook on the destructor in the
+// BSAnimGroupSequence vtable installed by ApplySequenceCacheHooks.
+class AnimSequenceCache
+{
+	static constexpr UInt32 kNumEntries = 1024;
+
+	// sequence pointer in the high dword, classification in the low dword
+	std::atomic<UInt64> entries_[kNumEntries] = {};
+
+	static UInt32 GetIndex(const BSAnimGroupSequence* sequence)
+	{
+		return (reinterpret_cast<UInt32>(sequence) >> 4) * 0x9E3779B1 >> 22;
+	}
+
+public:
+	AnimCustom Get(BSAnimGroupSequence* sequence);
+	void Invalidate(BSAnimGroupSequence* sequence);
+};
+
+extern AnimSequenceCache g_animSequenceCache;
+
+void ApplySequenceCacheHooks();
@@ -0,0 +1,92 @@
+#include "anim_variants.h"
+
+#include <cmath>
+#include <unordered_map>
+
+namespace
+{
+	std::unordered_map<PathId, float> s_animWeights;
+
+	float ParseWeightSuffix(const std::string& path)
+	{
+		const auto dot = path.find_last_of('.');
+		const auto underscore = path.find_last_of('_', dot);
+		if (dot == std::string::npos || underscore == std::string::npos || underscore + 2 >= dot)
+			return 1;
+		if (path[underscore + 1] != 'w' && path[underscore + 1] != 'W')
+			return 1;
+		UInt32 weight = 0;
+		for (auto i = underscore + 2; i < dot; ++i)
+		{
+			if (path[i] < '0' || path[i] > '9')
+				return 1;
+			weight = weight * 10 + (path[i] - '0');
+		}
+		return static_cast<float>(weight);
+	}
+
+	// negative, NaN or infinite weights would poison the alias table, they count as 0
+	float ClampWeight(float weight)
+	{
+		return std::isfinite(weight) && weight > 0 ? weight : 0;
+	}
+}
+
+float GetAnimWeight(PathId path)
+{
+	if (const auto iter = s_animWeights.find(path); iter != s_animWeights.end())
+		return iter->second;
+	return ParseWeightSuffix(g_animPathPool.GetPath(path));
+}
+
+void SetAnimWeight(PathId path, float weight)
+{
+	s_animWeights[path] = ClampWeight(weight);
+}
+
+void SavedAnims::Add(PathId path, float weight)
+{
+	anims.push_back(path);
+	weights.push_back(ClampWeight(weight));
+	BuildAliasTable();
+}
+
+void SavedAnims::BuildAliasTable()
+{
+	const UInt32 n = anims.size();
+	probs.assign(n, 1);
+	aliases.resize(n);
+	for (UInt32 i = 0; i < n; ++i)
+		aliases[i] = i;
+
+	float total = 0;
+	for (const auto weight : weights)
+		total += weight;
+	if (total <= 0)
+		return; // all zero, uniform
+
+	std::vector<UInt32> small, large;
+	for (UInt32 i = 0; i < n; ++i)
+	{
+		probs[i] = weights[i] * n / total;
+		(probs[i] < 1 ? small : large).push_back(i);
+	}
+	while (!small.empty() && !large.empty())
+	{
+		const auto less = small.back();
+		const auto more = large.back();
+		small.pop_back();
+		aliases[less] = more;
+		probs[more] -= 1 - probs[less];
+		if (probs[more] < 1)
+		{
+			large.pop_back();
+			small.push_back(more);
+		}
+	}
+	// whatever is left is 1 up to rounding
+	for (const auto i : small)
+		probs[i] = 1;
+	for (const auto i : large)
+		probs[i] = 1;
+}
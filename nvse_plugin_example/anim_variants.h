@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "anim_path_pool.h"
+
+// xorshift32, small enough to keep one per actor so that variant picks can be replayed from a seed
+struct XorShift32
+{
+	UInt32 state;
+
+	explicit XorShift32(UInt32 seed = 0x2545F491) : state(seed ? seed : 0x2545F491) {}
+
+	UInt32 Next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	// uniform in [0, n)
+	UInt32 Next(UInt32 n)
+	{
+		return static_cast<UInt32>(static_cast<UInt64>(Next()) * n >> 32);
+	}
+
+	// uniform in [0, 1)
+	float NextFloat()
+	{
+		return (Next() >> 8) * (1.0F / 16777216.0F);
+	}
+};
+
+// A group of interchangeable animation variants. Each variant has a weight and picks are drawn in O(1)
+// from a Vose alias table which is rebuilt whenever the group changes.
+struct SavedAnims
+{
+	std::vector<PathId> anims;
+	std::vector<float> weights;
+	std::vector<float> probs;
+	std::vector<UInt32> aliases;
+
+	void Add(PathId path, float weight);
+	void BuildAliasTable();
+
+	// index into anims, anims must not be empty
+	UInt32 Pick(XorShift32& rng) const
+	{
+		const auto idx = rng.Next(anims.size());
+		return rng.NextFloat() < probs[idx] ? idx : aliases[idx];
+	}
+};
+
+// weight given to path with SetAnimWeight, otherwise parsed from a _w<weight> filename suffix
+// (e.g. attack_2_w3.kf), otherwise 1
+float GetAnimWeight(PathId path);
+void SetAnimWeight(PathId path, float weight);
@@ -1,9 +1,13 @@
 #include "commands_animation.h"
 
 #include <algorithm>
+#include <memory>
+#include <mutex>
 #include <stack>
 #include <unordered_set>
 
+#include "anim_file_tree.h"
+#include "anim_sequence_cache.h"
 #include "GameForms.h"
 #include "GameAPI.h"
 #include "GameObjects.h"
@@ -12,10 +16,8 @@
 #include "utility.h"
 #include "common/IDirectoryIterator.h"
 
-// Per ref ID there is a stack of animation variants per group ID
-using AnimOverrideMap = std::unordered_map<UInt32, std::unordered_map<UInt32, AnimStacks>>;
-AnimOverrideMap g_animGroupThirdPersonMap;
-AnimOverrideMap g_animGroupFirstPersonMap;
+// Per (ref ID, group ID, condition, POV) there is a stack of animation variants
+AnimOverrideSnapshots g_animOverrides;
 
 bool Cmd_ForcePlayIdle_Execute(COMMAND_ARGS)
 {
@@ -51,8 +53,54 @@ std::string GetFileNameNoExtension(const std::string& fileName, std::string& ext
 }
 
 
-std::vector<std::string> GetAnimationVariantPaths(const std::string& kfFilePath)
+// Animation name -> variant paths for one folder. Scripts tend to call Set*AnimationPath every frame,
+// so folders are only enumerated again once their modification time changes, which itself is checked
+// at most once per second. Variant lists are immutable once built and handed out as shared pointers,
+// so a rebuild by another thread never invalidates a list that is being iterated.
+using VariantPaths = std::shared_ptr<const std::vector<std::string>>;
+
+struct VariantFolderIndex
+{
+	bool built = false;
+	UInt64 mtime = 0;
+	DWORD lastCheck = 0;
+	std::unordered_map<std::string, VariantPaths> variants; // key is the lower case name before an '_'
+};
+
+std::unordered_map<std::string, VariantFolderIndex> g_variantFolderIndexes;
+std::mutex g_variantFolderIndexesMutex;
+
+UInt64 GetFolderModifiedTime(const std::string& path)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data))
+		return 0;
+	return (static_cast<UInt64>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
+void BuildVariantFolderIndex(const std::string& folderPath, VariantFolderIndex& index)
+{
+	std::unordered_map<std::string, std::vector<std::string>> variants;
+	for (IDirectoryIterator iter(folderPath.c_str()); !iter.Done(); iter.Next())
+	{
+		std::string iterExtension;
+		const auto iterFileName = ToLower(GetFileNameNoExtension(iter.GetFileName(), iterExtension));
+		if (_stricmp(iterExtension.c_str(), "kf") != 0)
+			continue;
+		const auto fullPath = iter.GetFullPath().substr(strlen("Data\\Meshes\\"));
+		// a file is a variant of every name it starts with that is followed by an underscore
+		for (auto pos = iterFileName.find('_'); pos != std::string::npos; pos = iterFileName.find('_', pos + 1))
+			variants[iterFileName.substr(0, pos)].push_back(fullPath);
+	}
+	index.variants.clear();
+	for (auto& [name, paths] : variants)
+		index.variants.emplace(name, std::make_shared<const std::vector<std::string>>(std::move(paths)));
+	index.built = true;
+}
+
+VariantPaths GetAnimationVariantPaths(const std::string& kfFilePath)
 {
+	static const VariantPaths s_noVariants = std::make_shared<const std::vector<std::string>>();
 	std::string fileName;
 	const auto folderPath = ExtractFolderPath(kfFilePath, fileName);
 	std::string extension;
@@ -61,28 +109,31 @@ std::vector<std::string> GetAnimationVariantPaths(const std::string& kfFilePath)
 	{
 		throw std::exception("Animation file does not end with .KF");
 	}
-	std::vector<std::string> result;
-	for (IDirectoryIterator iter(FormatString("Data\\Meshes\\%s", folderPath.c_str()).c_str()); !iter.Done(); iter.Next())
+	const auto meshesFolderPath = FormatString("Data\\Meshes\\%s", folderPath.c_str());
+	std::lock_guard lock(g_variantFolderIndexesMutex);
+	auto& index = g_variantFolderIndexes[ToLower(meshesFolderPath)];
+	const auto now = GetTickCount();
+	if (!index.built || now - index.lastCheck > 1000)
 	{
-		std::string iterExtension;
-		auto iterFileName = GetFileNameNoExtension(iter.GetFileName(), iterExtension);
-		if (_stricmp(iterExtension.c_str(), "kf") == 0)
+		index.lastCheck = now;
+		const auto mtime = GetFolderModifiedTime(meshesFolderPath);
+		if (!index.built || mtime != index.mtime)
 		{
-			if (iterFileName.rfind(animName + '_', 0) == 0)
-			{
-				auto fullPath = iter.GetFullPath();
-				result.push_back(fullPath.substr(strlen("Data\\Meshes\\")));
-			}
+			index.mtime = mtime;
+			BuildVariantFolderIndex(meshesFolderPath, index);
 		}
 	}
-	return result;
+	const auto iter = index.variants.find(ToLower(animName));
+	return iter != index.variants.end() ? iter->second : s_noVariants;
 }
 
 static ModelLoader** g_modelLoader = reinterpret_cast<ModelLoader**>(0x106CA70);
 
-KFModel* LoadAnimation(const std::string& path, AnimData* animData)
+// KF models stay owned by the model loader's kfMap, which also serves repeat loads. A KFModel has no
+// reference count the loader respects, so the plugin cannot keep one resident or evict it on its own.
+KFModel* LoadAnimation(PathId path, AnimData* animData)
 {
-	auto* kfModel = GameFuncs::LoadKFModel(*g_modelLoader, path.c_str());
+	auto* kfModel = GameFuncs::LoadKFModel(*g_modelLoader, g_animPathPool.GetPath(path).c_str());
 	if (kfModel && kfModel->animGroup && animData)
 	{
 		kfModel->animGroup->groupID = 0xF5; // use a free anim group slot
@@ -92,75 +143,81 @@ KFModel* LoadAnimation(const std::string& path, AnimData* animData)
 	return nullptr;
 }
 
-BSAnimGroupSequence* GetAnimationFromMap(AnimOverrideMap& map, UInt32 id, UInt32 animGroupId, AnimData* animData, const char* prevPath = nullptr)
+// per actor generators exist only for actors given a seed with SetActorAnimationSeed and are published
+// with the overrides, the unseeded generator is per thread
+thread_local XorShift32 t_animRng(GetTickCount() ^ GetCurrentThreadId());
+
+UInt32 PickAnimVariant(const AnimOverrideIndex& overrides, const SavedAnims& anims, const Actor* actor)
 {
-	const auto mapIter = map.find(id);
-	if (mapIter != map.end())
+	if (auto* state = actor ? overrides.FindActorRng(actor->refID) : nullptr)
 	{
-		const auto stacksIter = mapIter->second.find(animGroupId);
-		if (stacksIter != mapIter->second.end())
+		// pick on a local copy and retry if another thread advanced the generator in between
+		auto cur = state->load(std::memory_order_relaxed);
+		for (;;)
 		{
-			auto animCustom = AnimCustom::None;
-			if (prevPath)
-			{
-				if (FindStringCI(prevPath, R"(\male\)"))
-					animCustom = AnimCustom::Male;
-				else if (FindStringCI(prevPath, R"(\female\)"))
-					animCustom = AnimCustom::Female;
-				else if (FindStringCI(prevPath, R"(\hurt\)"))
-					animCustom = AnimCustom::Hurt;
-			}
-
-			auto& stack = stacksIter->second.Get(animCustom);
-			if (!stack.empty())
-			{
-				auto& anims = stack.back();
-				if (!anims.anims.empty())
-				{
-					// pick random variant
-					auto& savedAnim = anims.anims.at(GetRandomUInt(stack.size()));
-					const auto* model = LoadAnimation(savedAnim, animData);
-					if (model)
-						return model->controllerSequence;
-				}
-			}
+			XorShift32 rng(cur);
+			const auto idx = anims.Pick(rng);
+			if (state->compare_exchange_weak(cur, rng.state, std::memory_order_relaxed))
+				return idx;
 		}
 	}
-	return nullptr;
+	return anims.Pick(t_animRng);
 }
 
-AnimOverrideMap& GetMap(bool firstPerson)
+BSAnimGroupSequence* GetAnimationFromMap(const AnimOverrideIndex& overrides, UInt32 id, UInt32 animGroupId, bool firstPerson, AnimData* animData, AnimCustom animCustom = AnimCustom::None)
 {
-	return firstPerson ? g_animGroupFirstPersonMap : g_animGroupThirdPersonMap;
+	const auto* stack = overrides.Find(id, animGroupId, animCustom, firstPerson);
+	if (stack && !stack->empty())
+	{
+		const auto& anims = stack->back();
+		if (!anims.anims.empty())
+		{
+			// pick weighted random variant
+			const auto savedAnim = anims.anims[PickAnimVariant(overrides, anims, animData ? animData->actor : nullptr)];
+			const auto* model = LoadAnimation(savedAnim, animData);
+			if (model)
+				return model->controllerSequence;
+		}
+	}
+	return nullptr;
 }
 
 BSAnimGroupSequence* GetWeaponAnimation(TESObjectWEAP* weapon, UInt32 animGroupId, bool firstPerson, AnimData* animData)
 {
-	auto& map = GetMap(firstPerson);
-	if (auto* result = GetAnimationFromMap(map, weapon->refID, animGroupId, animData))
+	const AnimOverrideSnapshots::Reader overrides(g_animOverrides);
+	if (auto* result = GetAnimationFromMap(*overrides, weapon->refID, animGroupId, firstPerson, animData))
 		return result;
-	return GetAnimationFromMap(map, weapon->GetModIndex(), animGroupId, animData);
+	return GetAnimationFromMap(*overrides, weapon->GetModIndex(), animGroupId, firstPerson, animData);
 }
 
-BSAnimGroupSequence* GetActorAnimation(Actor* actor, UInt32 animGroupId, bool firstPerson, AnimData* animData, const char* prevPath)
+BSAnimGroupSequence* GetActorAnimation(Actor* actor, UInt32 animGroupId, bool firstPerson, AnimData* animData, BSAnimGroupSequence* prevSequence)
 {
-	auto& map = GetMap(firstPerson);
-	if (auto* result = GetAnimationFromMap(map, actor->refID, animGroupId, animData, prevPath))
+	const AnimOverrideSnapshots::Reader overrides(g_animOverrides);
+	// classify once for all fallbacks, and only if there is anything conditioned to look up
+	const auto animCustom = prevSequence && overrides->HasCustomStacks() ? g_animSequenceCache.Get(prevSequence) : AnimCustom::None;
+	if (auto* result = GetAnimationFromMap(*overrides, actor->refID, animGroupId, firstPerson, animData, animCustom))
 		return result;
 	if (auto* baseForm = actor->baseForm)
-		return GetAnimationFromMap(map, baseForm->refID, animGroupId, animData, prevPath);
-	return GetAnimationFromMap(map, actor->GetModIndex(), animGroupId, animData, prevPath);
+		return GetAnimationFromMap(*overrides, baseForm->refID, animGroupId, firstPerson, animData, animCustom);
+	return GetAnimationFromMap(*overrides, actor->GetModIndex(), animGroupId, firstPerson, animData, animCustom);
 }
 
-int GetAnimGroupId(const std::string& path)
+int GetAnimGroupId(PathId pathId)
 {
 	UInt32 animGroupId;
-	static std::unordered_map<std::string, UInt16> s_animGroupIds;
-	const auto iter = s_animGroupIds.find(path);
+	static std::unordered_map<PathId, UInt16> s_animGroupIds;
+	const auto& path = g_animPathPool.GetPath(pathId);
+	const auto iter = s_animGroupIds.find(pathId);
 	if (iter != s_animGroupIds.end())
 	{
 		animGroupId = iter->second;
 	}
+	else if (const auto manifestGroupId = g_animFileTree.GetGroupId(path); manifestGroupId != -1)
+	{
+		// resolved on a previous launch and the file has not changed since
+		animGroupId = manifestGroupId;
+		s_animGroupIds[pathId] = animGroupId;
+	}
 	else
 	{
 		auto* kfModel = GameFuncs::LoadKFModel(*g_modelLoader, path.c_str());
@@ -172,37 +229,34 @@ int GetAnimGroupId(const std::string& path)
 				Log("KF file is missing AnimGroup data!");
 			return -1;
 		}
-		s_animGroupIds[path] = animGroupId;
+		s_animGroupIds[pathId] = animGroupId;
+		g_animFileTree.SetGroupId(path, animGroupId);
 	}
 	return animGroupId;
 }
 
 
-void SetOverrideAnimation(const UInt32 refId, std::string path, AnimOverrideMap& map, bool enable, bool append)
+PathId ResolveOverridePath(std::string path, int& groupId)
 {
 	std::replace(path.begin(), path.end(), '/', '\\');
-	const auto groupId = GetAnimGroupId(path);
+	const auto pathId = g_animPathPool.Intern(path);
+	if (pathId == kInvalidPathId)
+		throw std::exception(FormatString("Too many animation paths to add '%s'", path.c_str()).c_str());
+	groupId = GetAnimGroupId(pathId);
 	if (groupId == -1)
 		throw std::exception(FormatString("Failed to resolve file '%s'", path.c_str()).c_str());
-	auto& animGroupMap = map[refId];
-	auto& stacks = animGroupMap[groupId];
+	return pathId;
+}
 
+// returns true if the path was added to the stack
+bool ApplyOverrideAnimation(AnimOverrideIndex& overrides, const UInt32 refId, PathId pathId, UInt32 groupId, bool firstPerson, bool enable, bool append)
+{
 	// condition based animations
-	auto animCustom = AnimCustom::None;
-	if (FindStringCI(path, R"(\male\)"))
-		animCustom = AnimCustom::Male;
-	else if (FindStringCI(path, R"(\female\)"))
-		animCustom = AnimCustom::Female;
-	else if (FindStringCI(path, R"(\hurt\)"))
-		animCustom = AnimCustom::Hurt;
-
-	auto& stack = stacks.Get(animCustom);
+	const auto animCustom = g_animPathPool.GetCustom(pathId);
+	auto& stack = overrides.Get(refId, groupId, animCustom, firstPerson);
 	const auto findFn = [&](const SavedAnims& a)
 	{
-		for (const auto& s : a.anims)
-			if (_stricmp(path.c_str(), s.c_str()) == 0)
-				return true;
-		return false;
+		return std::find(a.anims.begin(), a.anims.end(), pathId) != a.anims.end();
 	};
 	
 	if (!enable)
@@ -210,41 +264,101 @@ void SetOverrideAnimation(const UInt32 refId, std::string path, AnimOverrideMap&
 		// remove from stack
 		const auto iter = std::remove_if(stack.begin(), stack.end(), findFn);
 		stack.erase(iter, stack.end());
-		return;
+		return false;
 	}
 	// check if stack already contains path
 	if (const auto iter = std::find_if(stack.begin(), stack.end(), findFn); iter != stack.end())
 	{
 		// move iter to the top of stack
 		std::rotate(iter, iter + 1, stack.end());
-		return;
+		return false;
 	}
 	if (!append || stack.empty())
 		stack.emplace_back();
 
 	auto& anims = stack.back();
-	Log(FormatString("AnimGroup %X for form %X will be overridden with animation %s\n", groupId, refId, path.c_str()));
-	anims.anims.emplace_back(path);
+	anims.Add(pathId, GetAnimWeight(pathId));
+	return true;
+}
+
+void SetOverrideAnimation(const UInt32 refId, std::string path, bool firstPerson, bool enable, bool append)
+{
+	const AnimOverrideSnapshots::Writer overrides(g_animOverrides);
+	int groupId;
+	const auto pathId = ResolveOverridePath(std::move(path), groupId);
+	if (ApplyOverrideAnimation(*overrides, refId, pathId, groupId, firstPerson, enable, append))
+		Log(FormatString("AnimGroup %X for form %X will be overridden with animation %s\n", groupId, refId, g_animPathPool.GetPath(pathId).c_str()));
 }
 
 void OverrideActorAnimation(const Actor* actor, const std::string& path, bool firstPerson, bool enable, bool append)
 {
-	auto& map = GetMap(firstPerson);
 	if (firstPerson && actor != *g_thePlayer)
 		throw std::exception("Cannot apply first person animations on actors other than player!");
-	SetOverrideAnimation(actor->refID, path, map, enable, append);
+	SetOverrideAnimation(actor->refID, path, firstPerson, enable, append);
 }
 
 void OverrideWeaponAnimation(const TESObjectWEAP* weapon, const std::string& path, bool firstPerson, bool enable, bool append)
 {
-	auto& map = GetMap(firstPerson);
-	SetOverrideAnimation(weapon->refID, path, map, enable, append);
+	SetOverrideAnimation(weapon->refID, path, firstPerson, enable, append);
 }
 
 void OverrideModIndexAnimation(const UInt8 modIdx, const std::string& path, bool firstPerson, bool enable, bool append)
 {
-	auto& map = GetMap(firstPerson);
-	SetOverrideAnimation(modIdx, path, map, enable, append);
+	SetOverrideAnimation(modIdx, path, firstPerson, enable, append);
+}
+
+UInt32 OverrideAnimationsBatch(const AnimOverrideBatchEntry* entries, UInt32 count)
+{
+	// published once when done, a stack per entry at most, the variants of an entry share its stack
+	const AnimOverrideSnapshots::Writer overrides(g_animOverrides);
+	overrides->Reserve(overrides->Size() + count);
+	UInt32 numApplied = 0;
+	for (UInt32 i = 0; i < count; ++i)
+	{
+		const auto& entry = entries[i];
+		try
+		{
+			if (!entry.form || !entry.path)
+				throw std::exception("Missing form or path");
+			if (const auto* actor = DYNAMIC_CAST(entry.form, TESForm, Actor))
+			{
+				if (entry.firstPerson && actor != *g_thePlayer)
+					throw std::exception("Cannot apply first person animations on actors other than player!");
+			}
+			else if (!DYNAMIC_CAST(entry.form, TESForm, TESObjectWEAP))
+				throw std::exception(FormatString("Form %X is neither a weapon nor an actor", entry.form->refID).c_str());
+
+			// resolve the variants before applying anything, so a row that fails leaves the index untouched
+			int groupId;
+			const auto pathId = ResolveOverridePath(entry.path, groupId);
+			std::vector<std::pair<PathId, int>> variants;
+			if (entry.enable)
+			{
+				const auto variantPaths = GetAnimationVariantPaths(entry.path);
+				for (const auto& variantPath : *variantPaths)
+				{
+					int variantGroupId;
+					const auto variantId = ResolveOverridePath(variantPath, variantGroupId);
+					variants.emplace_back(variantId, variantGroupId);
+				}
+			}
+			ApplyOverrideAnimation(*overrides, entry.form->refID, pathId, groupId, entry.firstPerson, entry.enable, false);
+			for (const auto& [variantId, variantGroupId] : variants)
+				ApplyOverrideAnimation(*overrides, entry.form->refID, variantId, variantGroupId, entry.firstPerson, true, true);
+			++numApplied;
+		}
+		catch (std::exception& e)
+		{
+			Log(FormatString("Animation override batch entry %d (%s): %s", i, entry.path ? entry.path : "<null>", e.what()));
+		}
+	}
+	Log(FormatString("Applied %d of %d animation overrides from batch", numApplied, count));
+	return numApplied;
+}
+
+extern "C" UInt32 __cdecl kNVSE_OverrideAnimationsBatch(const AnimOverrideBatchEntry* entries, UInt32 count)
+{
+	return OverrideAnimationsBatch(entries, count);
 }
 
 void LogScript(Script* scriptObj, TESForm* form, const std::string& funcName)
@@ -272,8 +386,8 @@ bool Cmd_SetWeaponAnimationPath_Execute(COMMAND_ARGS)
 		OverrideWeaponAnimation(weapon, path, firstPerson, enable, false);
 		if (enable)
 		{
-			auto paths = GetAnimationVariantPaths(path);
-			for (auto& pathIter : paths)
+			const auto paths = GetAnimationVariantPaths(path);
+			for (const auto& pathIter : *paths)
 			{
 				OverrideWeaponAnimation(weapon, pathIter, firstPerson, true, true);
 			}
@@ -306,8 +420,8 @@ bool Cmd_SetActorAnimationPath_Execute(COMMAND_ARGS)
 		OverrideActorAnimation(actor, path, firstPerson, enable, false);
 		if (enable)
 		{
-			auto paths = GetAnimationVariantPaths(path);
-			for (auto& pathIter : paths)
+			const auto paths = GetAnimationVariantPaths(path);
+			for (const auto& pathIter : *paths)
 			{
 				OverrideActorAnimation(actor, pathIter, firstPerson, true, true);
 			}
@@ -361,4 +475,67 @@ bool Cmd_PlayAnimationPath_Execute(COMMAND_ARGS)
 	
 	*result = 1;
 	return true;
+}
+
+bool Cmd_SetActorAnimationSeed_Execute(COMMAND_ARGS)
+{
+	*result = 0;
+	UInt32 seed = 0;
+	if (!ExtractArgs(EXTRACT_ARGS, &seed))
+		return true;
+	auto* actor = DYNAMIC_CAST(thisObj, TESForm, Actor);
+	if (!actor)
+		return true;
+	// makes this actor's variant picks reproducible
+	const AnimOverrideSnapshots::Writer overrides(g_animOverrides);
+	overrides->SeedActorRng(actor->refID, seed);
+	*result = 1;
+	return true;
+}
+
+bool Cmd_SetAnimationPathsBatch_Execute(COMMAND_ARGS)
+{
+	*result = 0;
+	NVSEArrayVarInterface::Array* arr = nullptr;
+	if (!ExtractArgs(EXTRACT_ARGS, &arr) || !arr)
+		return true;
+	const auto size = g_arrayInterface->GetArraySize(arr);
+	if (size == (UInt32)-1)
+		return true;
+
+	// rows of [form, path, first person, (enable)]
+	std::vector<NVSEArrayVarInterface::Element> rows(size);
+	g_arrayInterface->GetElements(arr, rows.data(), nullptr);
+	std::vector<std::string> paths;
+	std::vector<TESForm*> forms;
+	std::vector<std::pair<bool, bool>> flags;
+	paths.reserve(size);
+	for (UInt32 i = 0; i < size; ++i)
+	{
+		auto* row = rows[i].Array();
+		const auto rowSize = row ? g_arrayInterface->GetArraySize(row) : 0;
+		if (rowSize < 3 || rowSize > 4)
+		{
+			ShowRuntimeError(scriptObj, "SetAnimationPathsBatch: element %d is not an array of form, path, first person and optionally enable", i);
+			continue;
+		}
+		NVSEArrayVarInterface::Element cols[4];
+		g_arrayInterface->GetElements(row, cols, nullptr);
+		if (!cols[0].Form() || !cols[1].String())
+		{
+			ShowRuntimeError(scriptObj, "SetAnimationPathsBatch: element %d has an invalid form or path", i);
+			continue;
+		}
+		forms.push_back(cols[0].Form());
+		paths.emplace_back(cols[1].String());
+		flags.emplace_back(cols[2].Number() != 0, rowSize < 4 || cols[3].Number() != 0);
+	}
+
+	std::vector<AnimOverrideBatchEntry> entries;
+	entries.reserve(paths.size());
+	for (UInt32 i = 0; i < paths.size(); ++i)
+		entries.push_back(AnimOverrideBatchEntry{forms[i], paths[i].c_str(), flags[i].first, flags[i].second});
+	Log(FormatString("Script %s %X from mod %s has called SetAnimationPathsBatch with %d entries", scriptObj->GetName(), scriptObj->refID, GetModName(scriptObj), entries.size()));
+	*result = OverrideAnimationsBatch(entries.data(), entries.size());
+	return true;
 }
\ No newline at end of file
@@ -2,38 +2,8 @@
 #include "GameObjects.h"
 
 #include "ParamInfos.h"
-
-struct SavedAnims
-{
-	std::vector<std::string> anims;
-};
-
-enum class AnimCustom
-{
-	None, Male, Female, Hurt
-};
-
-
-struct AnimStacks
-{
-	std::vector<SavedAnims> anims;
-	std::vector<SavedAnims> maleAnims;
-	std::vector<SavedAnims> femaleAnims;
-	std::vector<SavedAnims> hurtAnims;
-
-	std::vector<SavedAnims>& Get(const AnimCustom custom)
-	{
-		switch (custom) 
-		{ 
-		case AnimCustom::None: return anims;
-		case AnimCustom::Male: return maleAnims;
-		case AnimCustom::Female: return femaleAnims;
-		case AnimCustom::Hurt: return hurtAnims;
-		default: break;
-		}
-		return anims;
-	}
-};
+#include "PluginAPI.h"
+#include "anim_override_index.h"
 
 enum AnimHandTypes
 {
@@ -82,7 +52,7 @@ namespace GameFuncs
 }
 
 BSAnimGroupSequence* GetWeaponAnimation(TESObjectWEAP* weapon, UInt32 animGroupId, bool firstPerson, AnimData* animData);
-BSAnimGroupSequence* GetActorAnimation(Actor* actor, UInt32 animGroupId, bool firstPerson, AnimData* animData, const char* prevPath);
+BSAnimGroupSequence* GetActorAnimation(Actor* actor, UInt32 animGroupId, bool firstPerson, AnimData* animData, BSAnimGroupSequence* prevSequence);
 
 static ParamInfo kParams_SetWeaponAnimationPath[] =
 {
@@ -110,6 +80,28 @@ DEFINE_COMMAND_PLUGIN(ForcePlayIdle, "", true, 1, kParams_OneForm)
 DEFINE_COMMAND_PLUGIN(SetWeaponAnimationPath, "", false, sizeof kParams_SetWeaponAnimationPath / sizeof(ParamInfo), kParams_SetWeaponAnimationPath)
 DEFINE_COMMAND_PLUGIN(SetActorAnimationPath, "", true, sizeof kParams_SetActorAnimationPath / sizeof(ParamInfo), kParams_SetActorAnimationPath)
 DEFINE_COMMAND_PLUGIN(PlayAnimationPath, "", true, sizeof kParams_PlayAnimationPath / sizeof(ParamInfo), kParams_PlayAnimationPath)
+static ParamInfo kParams_SetAnimationPathsBatch[] =
+{
+	{"overrides", kParamType_Array, 0},
+};
+
+DEFINE_COMMAND_PLUGIN(SetActorAnimationSeed, "", true, 1, kParams_OneInt)
+DEFINE_COMMAND_PLUGIN(SetAnimationPathsBatch, "", false, 1, kParams_SetAnimationPathsBatch)
+
+extern NVSEArrayVarInterface* g_arrayInterface;
+extern AnimOverrideSnapshots g_animOverrides;
+
+// Batch registration for plugins, exported as kNVSE_OverrideAnimationsBatch. Layout is part of the ABI.
+struct AnimOverrideBatchEntry
+{
+	TESForm* form; // weapon or actor reference
+	const char* path;
+	bool firstPerson;
+	bool enable;
+};
+
+// returns the number of entries applied, failures are logged
+UInt32 OverrideAnimationsBatch(const AnimOverrideBatchEntry* entries, UInt32 count);
 
 void OverrideActorAnimation(const Actor* actor, const std::string& path, bool firstPerson, bool enable, bool append);
 void OverrideWeaponAnimation(const TESObjectWEAP* weapon, const std::string& path, bool firstPerson, bool enable, bool append);
@@ -1,46 +1,51 @@
+#include <cmath>
 #include <filesystem>
 #include "utility.h"
+#include "anim_file_tree.h"
 #include "commands_animation.h"
 #include "file_animations.h"
 #include "json.h"
 #include <fstream>
+#include <future>
 #include <utility>
 
 #include "GameData.h"
 #include "GameAPI.h"
 #include "GameRTTI.h"
 
-void LoadPathsForList(const BGSListForm* listForm, const std::filesystem::path& path, bool firstPerson);
+void LoadPathsForList(const BGSListForm* listForm, const std::string& path, bool firstPerson);
 
 template <typename T>
-void LoadPathsForType(const std::filesystem::path& path, const T identifier, bool firstPerson)
+void LoadPathsForType(const std::string& path, const T identifier, bool firstPerson)
 {
-	auto append = false;
-	for (std::filesystem::recursive_directory_iterator iter(path), end; iter != end; ++iter)
+	if constexpr (std::is_same<T, const BGSListForm*>::value)
 	{
-		if (_stricmp(iter->path().extension().string().c_str(), ".kf") != 0)
-			continue;
-		const auto fullPath = iter->path().string();
-		auto str = fullPath.substr(fullPath.find("AnimGroupOverride\\"));
-		Log("Loading animation path " + str + "...");
-		try
-		{
-			if constexpr (std::is_same<T, const TESObjectWEAP*>::value)
-				OverrideWeaponAnimation(identifier, str, firstPerson, true, append);
-			else if constexpr (std::is_same<T, const Actor*>::value)
-				OverrideActorAnimation(identifier, str, firstPerson, true, append);
-			else if constexpr (std::is_same<T, UInt8>::value)
-				OverrideModIndexAnimation(identifier, str, firstPerson, true, append);
-			else if constexpr (std::is_same<T, const BGSListForm*>::value)
-				LoadPathsForList(identifier, path, firstPerson);
-			else
-				static_assert(false);
-		}
-		catch (std::exception& e)
+		// the folder is shared by every member of the list
+		LoadPathsForList(identifier, path, firstPerson);
+	}
+	else
+	{
+		auto append = false;
+		for (const auto& str : g_animFileTree.GetFilesRecursive(path, ".kf"))
 		{
-			Log(FormatString("AnimGroupOverride Error: %s", e.what()));
+			Log("Loading animation path " + str + "...");
+			try
+			{
+				if constexpr (std::is_same<T, const TESObjectWEAP*>::value)
+					OverrideWeaponAnimation(identifier, str, firstPerson, true, append);
+				else if constexpr (std::is_same<T, const Actor*>::value)
+					OverrideActorAnimation(identifier, str, firstPerson, true, append);
+				else if constexpr (std::is_same<T, UInt8>::value)
+					OverrideModIndexAnimation(identifier, str, firstPerson, true, append);
+				else
+					static_assert(false);
+			}
+			catch (std::exception& e)
+			{
+				Log(FormatString("AnimGroupOverride Error: %s", e.what()));
+			}
+			append = true;
 		}
-		append = true;
 	}
 }
 
@@ -49,7 +54,7 @@ void LogForm(const TESForm* form)
 	Log(FormatString("Detected in-game form %X %s %s", form->refID, form->GetName(), form->GetFullName() ? form->GetFullName()->name.CStr() : "<no name>"));
 }
 
-void LoadPathsForList(const BGSListForm* listForm, const std::filesystem::path& path, bool firstPerson)
+void LoadPathsForList(const BGSListForm* listForm, const std::string& path, bool firstPerson)
 {
 	for (auto iter = listForm->list.Begin(); !iter.End(); ++iter)
 	{
@@ -64,129 +69,299 @@ void LoadPathsForList(const BGSListForm* listForm, const std::filesystem::path&
 }
 
 template <typename T>
-void LoadPathsForPOV(const std::filesystem::path& path, const T identifier)
+void LoadPathsForPOV(const std::string& path, const T identifier)
 {
 	for (const auto& pair : {std::make_pair("\\_male", false), std::make_pair("\\_1stperson", true)})
 	{
-		auto iterPath = path.string() + std::string(pair.first);
-		if (std::filesystem::exists(iterPath))
+		auto iterPath = path + std::string(pair.first);
+		if (g_animFileTree.GetDirectory(iterPath))
 			LoadPathsForType(iterPath, identifier, pair.second);
 	}
 }
 
-void LoadModAnimPaths(const std::filesystem::path& path, const ModInfo* mod)
+void LoadModAnimPaths(const AnimFileTree::Directory& modDir, const ModInfo* mod)
 {
-	LoadPathsForPOV<const UInt8>(path, mod->modIndex);
-	for (std::filesystem::directory_iterator iter(path), end; iter != end; ++iter)
+	LoadPathsForPOV<const UInt8>(modDir.path, mod->modIndex);
+	for (const auto& folderName : modDir.subdirs)
 	{
-		const auto& iterPath = iter->path();
-		Log("Loading form ID " + iterPath.string());
-		if (iter->is_directory())
+		const auto iterPath = modDir.path + '\\' + folderName;
+		Log("Loading form ID " + iterPath);
+		try
 		{
-			
-			try
+			const auto id = HexStringToInt(folderName);
+			if (id != -1) 
 			{
-				const auto& folderName = iterPath.filename().string();
-				const auto id = HexStringToInt(folderName);
-				if (id != -1) 
+				const auto formId = (id & 0x00FFFFFF) + (mod->modIndex << 24);
+				auto* form = LookupFormByID(formId);
+				if (form)
 				{
-					const auto formId = (id & 0x00FFFFFF) + (mod->modIndex << 24);
-					auto* form = LookupFormByID(formId);
-					if (form)
-					{
-						LogForm(form);
-						if (const auto* weapon = DYNAMIC_CAST(form, TESForm, TESObjectWEAP))
-							LoadPathsForPOV(iterPath, weapon);
-						else if (const auto* actor = DYNAMIC_CAST(form, TESForm, Actor))
-							LoadPathsForPOV(iterPath, actor);
-						else if (const auto* list = DYNAMIC_CAST(form, TESForm, BGSListForm))
-							LoadPathsForPOV(iterPath, list);
-						else
-							Log(FormatString("Unsupported form type for %X", form->refID));
-					}
+					LogForm(form);
+					if (const auto* weapon = DYNAMIC_CAST(form, TESForm, TESObjectWEAP))
+						LoadPathsForPOV(iterPath, weapon);
+					else if (const auto* actor = DYNAMIC_CAST(form, TESForm, Actor))
+						LoadPathsForPOV(iterPath, actor);
+					else if (const auto* list = DYNAMIC_CAST(form, TESForm, BGSListForm))
+						LoadPathsForPOV(iterPath, list);
 					else
-					{
-						Log(FormatString("kNVSE Animation: Form %X not found!", formId));
-					}
+						Log(FormatString("Unsupported form type for %X", form->refID));
+				}
+				else
+				{
+					Log(FormatString("kNVSE Animation: Form %X not found!", formId));
 				}
 			}
-			catch (std::exception&) {}
-		}
-		else
-		{
-			Log("Skipping as path is not a directory...");
 		}
+		catch (std::exception&) {}
 	}
 }
 
+// optional "weights": {"file.kf": weight} object of an entry
+using JSONWeights = std::vector<std::pair<std::string, float>>;
+
 struct JSONEntry
 {
 	const std::string folderName;
 	const TESForm* form;
+	const JSONWeights weights;
 
-	JSONEntry(std::string folderName, const TESForm* form)
-		: folderName(std::move(folderName)), form(form)
+	JSONEntry(std::string folderName, const TESForm* form, JSONWeights weights)
+		: folderName(std::move(folderName)), form(form), weights(std::move(weights))
 	{
 	}
 };
 
+// entry as read from the file, before its mod and form are resolved
+struct JSONRawEntry
+{
+	std::string mod;
+	std::string form;
+	std::string folder;
+	JSONWeights weights;
+};
+
+struct JSONFileResult
+{
+	std::string fileName;
+	std::vector<JSONRawEntry> entries;
+	std::vector<std::string> log; // logging is deferred to the main thread
+	bool error = false;
+};
+
 std::vector<JSONEntry> g_jsonEntries;
-std::unordered_map<std::string, std::filesystem::path> g_jsonFolders;
+std::unordered_map<std::string, std::string> g_jsonFolders;
+std::future<std::vector<JSONFileResult>> g_jsonFiles;
 
-void HandleJson(const std::filesystem::path& path)
+// Streams a JSON array of {mod, form, folder} objects straight into JSONRawEntry without building a DOM
+class JSONEntryReader final : public nlohmann::json_sax<nlohmann::json>
 {
-	Log("Reading from JSON file " + path.string());
-	
-	try
+	JSONFileResult& result_;
+	UInt32 depth_ = 0;
+	JSONRawEntry entry_;
+	std::string* field_ = nullptr;
+	bool weightsKey_ = false;
+	bool inWeights_ = false;
+	std::string weightFile_;
+
+	bool Number(float value)
 	{
+		if (depth_ == 3 && inWeights_ && !weightFile_.empty())
+		{
+			if (!std::isfinite(value) || value < 0)
+			{
+				result_.log.push_back(FormatString("JSON error: invalid weight for %s, using 0", weightFile_.c_str()));
+				value = 0;
+			}
+			entry_.weights.emplace_back(std::move(weightFile_), value);
+			weightFile_.clear();
+			return true;
+		}
+		return Scalar();
+	}
+
+	bool Scalar()
+	{
+		if (depth_ == 0)
+			return NotAnArray();
+		if (depth_ == 1)
+			result_.log.emplace_back("JSON error: expected object with mod, form and folder fields");
+		field_ = nullptr;
+		return true;
+	}
+
+	bool NotAnArray()
+	{
+		result_.log.push_back(result_.fileName + " does not start as a JSON array");
+		return false;
+	}
+
+public:
+	explicit JSONEntryReader(JSONFileResult& result) : result_(result) {}
+
+	bool null() override { return Scalar(); }
+	bool boolean(bool) override { return Scalar(); }
+	bool number_integer(number_integer_t val) override { return Number(static_cast<float>(val)); }
+	bool number_unsigned(number_unsigned_t val) override { return Number(static_cast<float>(val)); }
+	bool number_float(number_float_t val, const string_t&) override { return Number(static_cast<float>(val)); }
+	bool binary(binary_t&) override { return Scalar(); }
+
+	bool string(string_t& val) override
+	{
+		if (depth_ == 2 && field_)
+		{
+			*field_ = std::move(val);
+			field_ = nullptr;
+			return true;
+		}
+		return Scalar();
+	}
+
+	bool start_object(std::size_t) override
+	{
+		if (depth_ == 0)
+			return NotAnArray();
+		if (++depth_ == 2)
+			entry_ = JSONRawEntry();
+		inWeights_ = depth_ == 3 && weightsKey_;
+		field_ = nullptr;
+		weightsKey_ = false;
+		return true;
+	}
+
+	bool key(string_t& val) override
+	{
+		field_ = nullptr;
+		weightsKey_ = false;
+		if (depth_ == 3 && inWeights_)
+			weightFile_ = std::move(val);
+		if (depth_ != 2)
+			return true;
+		if (val == "mod")
+			field_ = &entry_.mod;
+		else if (val == "form")
+			field_ = &entry_.form;
+		else if (val == "folder")
+			field_ = &entry_.folder;
+		else if (val == "weights")
+			weightsKey_ = true;
+		return true;
+	}
+
+	bool end_object() override
+	{
+		if (depth_ == 3)
+			inWeights_ = false;
+		if (depth_-- != 2)
+			return true;
+		if (entry_.mod.empty() || entry_.form.empty() || entry_.folder.empty())
+		{
+			result_.log.emplace_back("JSON error: expected string fields mod, form and folder");
+			result_.error = true;
+			return true;
+		}
+		result_.entries.push_back(std::move(entry_));
+		return true;
+	}
+
+	bool start_array(std::size_t) override
+	{
+		++depth_;
+		field_ = nullptr;
+		weightsKey_ = false;
+		return true;
+	}
+
+	bool end_array() override
+	{
+		--depth_;
+		return true;
+	}
+
+	bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+	{
+		result_.log.push_back(FormatString("JSON error: %s", ex.what()));
+		result_.error = true;
+		return false;
+	}
+};
+
+std::vector<JSONFileResult> ReadJsonFiles(const std::string& dir)
+{
+	std::vector<JSONFileResult> results;
+	std::error_code ec;
+	for (std::filesystem::directory_iterator iter(dir, ec), end; !ec && iter != end; iter.increment(ec))
+	{
+		const auto& path = iter->path();
+		if (_stricmp(path.extension().string().c_str(), ".json") != 0)
+			continue;
+		auto& result = results.emplace_back();
+		result.fileName = path.filename().string();
+		result.log.push_back("Reading from JSON file " + path.string());
 		std::ifstream i(path);
-		nlohmann::json j;
-		i >> j;
-		if (j.is_array())
+		JSONEntryReader reader(result);
+		nlohmann::json::sax_parse(i, &reader);
+	}
+	return results;
+}
+
+void StartJsonLoad()
+{
+	// only touches the filesystem, forms are resolved on the main thread once the game has loaded
+	g_jsonFiles = std::async(std::launch::async, ReadJsonFiles, GetCurPath() + R"(\Data\Meshes\AnimGroupOverride)");
+}
+
+void ResolveJsonEntries()
+{
+	if (!g_jsonFiles.valid())
+		StartJsonLoad();
+	std::unordered_map<std::string, const ModInfo*> mods;
+	for (auto& file : g_jsonFiles.get())
+	{
+		for (const auto& msg : file.log)
+			Log(msg);
+		if (file.error)
+			Console_Print("[%s] There was an error parsing JSON for AnimGroupOverride. Check kNVSE.log for more info.", file.fileName.c_str());
+		for (auto& entry : file.entries)
 		{
-			for (auto& elem : j)
+			auto modIter = mods.find(entry.mod);
+			if (modIter == mods.end())
+				modIter = mods.emplace(entry.mod, DataHandler::Get()->LookupModByName(entry.mod.c_str())).first;
+			const auto* mod = modIter->second;
+			if (!mod)
 			{
-				if (!elem.is_object())
-				{
-					Log("JSON error: expected object with mod, form and folder fields");
-					continue;
-				}
-				auto modName = elem["mod"].get<std::string>();
-				auto formIdStr = elem["form"].get<std::string>();
-				auto folder = elem["folder"].get<std::string>();
-				const auto* mod = DataHandler::Get()->LookupModByName(modName.c_str());
-				if (!mod)
-				{
-					Log("Mod name " + modName + " was not found");
-					continue;
-				}
-				auto formId = HexStringToInt(formIdStr);
-				if (formId == -1)
-				{
-					Log("Form field was incorrectly formatted, got " + formIdStr);
-					continue;
-				}
-				formId = (mod->modIndex << 24) + (formId & 0x00FFFFFF);
-				auto* form = LookupFormByID(formId);
-				if (!form)
-				{
-					Log(FormatString("Form %X was not found", formId));
-					continue;
-				}
-				LogForm(form);
-				Log(FormatString("Registered form %X for folder %s", formId, folder.c_str()));
-				g_jsonEntries.emplace_back(folder, form);
+				Log("Mod name " + entry.mod + " was not found");
+				continue;
+			}
+			auto formId = HexStringToInt(entry.form);
+			if (formId == -1)
+			{
+				Log("Form field was incorrectly formatted, got " + entry.form);
+				continue;
+			}
+			formId = (mod->modIndex << 24) + (formId & 0x00FFFFFF);
+			auto* form = LookupFormByID(formId);
+			if (!form)
+			{
+				Log(FormatString("Form %X was not found", formId));
+				continue;
 			}
+			LogForm(form);
+			Log(FormatString("Registered form %X for folder %s", formId, entry.folder.c_str()));
+			g_jsonEntries.emplace_back(std::move(entry.folder), form, std::move(entry.weights));
 		}
-		else
-			Log(path.string() + " does not start as a JSON array");
 	}
-	catch (nlohmann::json::exception& e)
+}
+
+void SetJsonWeights(const std::string& folder, const JSONWeights& weights)
+{
+	for (const auto& path : g_animFileTree.GetFilesRecursive(folder, ".kf"))
 	{
-		Log(FormatString("JSON error: %s", e.what()));
-		Console_Print("[%s] There was an error parsing JSON for AnimGroupOverride. Check kNVSE.log for more info.", path.filename().string().c_str());
+		const auto fileName = path.substr(path.find_last_of('\\') + 1);
+		for (const auto& [weightFile, weight] : weights)
+		{
+			if (_stricmp(fileName.c_str(), weightFile.c_str()) == 0)
+				SetAnimWeight(g_animPathPool.Intern(path), weight);
+		}
 	}
-	
 }
 
 void LoadJsonEntries()
@@ -196,6 +371,8 @@ void LoadJsonEntries()
 		Log(FormatString("JSON: Loading animations for form %X in path %s", entry.form->refID, entry.folderName.c_str()));
 		if (auto path = g_jsonFolders.find(entry.folderName); path != g_jsonFolders.end())
 		{
+			if (!entry.weights.empty())
+				SetJsonWeights(path->second, entry.weights);
 			if (const auto* weapon = DYNAMIC_CAST(entry.form, TESForm, TESObjectWEAP))
 			{
 				LoadPathsForPOV(path->second, weapon);
@@ -209,7 +386,7 @@ void LoadJsonEntries()
 				Log("JSON form error: form is neither weapon or actor");
 				continue;
 			}
-			Log(FormatString("Loaded from JSON folder %s to form %X", path->second.string().c_str(), entry.form->refID));
+			Log(FormatString("Loaded from JSON folder %s to form %X", path->second.c_str(), entry.form->refID));
 
 		}
 		else
@@ -220,41 +397,51 @@ void LoadJsonEntries()
 	g_jsonFolders.clear();
 }
 
-void LoadFileAnimPaths()
+void LoadOverridesFromDisk(const std::string& root)
 {
-	Log("Loading file anims");
-	const auto dir = GetCurPath() + R"(\Data\Meshes\AnimGroupOverride)";
-	if (std::filesystem::exists(dir))
+	// every override found on disk goes out to the animation hooks in a single snapshot
+	const AnimOverrideSnapshots::Writer overrides(g_animOverrides);
+	if (const auto* rootDir = g_animFileTree.GetDirectory(root))
 	{
-		for (std::filesystem::directory_iterator iter(dir.c_str()), end; iter != end; ++iter)
+		Log(FormatString("Scanned %d animation folders", g_animFileTree.NumDirectories()));
+		for (const auto& folderName : rootDir->subdirs)
 		{
-			const auto& path = iter->path();
-			const auto& fileName = path.filename();
-			if (iter->is_directory())
+			const auto path = root + '\\' + folderName;
+			const std::filesystem::path fileName = folderName;
+			Log(path + " found");
+
+			const auto* mod = DataHandler::Get()->LookupModByName(folderName.c_str());
+
+			if (mod)
 			{
-				Log(iter->path().string() + " found");
-				
-				const auto* mod = DataHandler::Get()->LookupModByName(fileName.string().c_str());
-				
-				if (mod)
-					LoadModAnimPaths(path, mod);
-				else if (_stricmp(fileName.extension().string().c_str(), ".esp") == 0 || _stricmp(fileName.extension().string().c_str(), ".esm") == 0)
-					Log(FormatString("Mod with name %s is not loaded!", fileName.string().c_str()));
-				else if (_stricmp(fileName.string().c_str(), "_male") != 0 && _stricmp(fileName.string().c_str(), "_1stperson") != 0)
-				{
-					g_jsonFolders.emplace(path.filename().string(), path);
-					Log("Found anim folder " + fileName.string() + " which can be used in JSON");
-				}
+				// missing if the folder could not be read during the scan
+				if (const auto* dir = g_animFileTree.GetDirectory(path))
+					LoadModAnimPaths(*dir, mod);
+				else
+					Log(path + " could not be read");
 			}
-			else if (_stricmp(path.extension().string().c_str(), ".json") == 0)
+			else if (_stricmp(fileName.extension().string().c_str(), ".esp") == 0 || _stricmp(fileName.extension().string().c_str(), ".esm") == 0)
+				Log(FormatString("Mod with name %s is not loaded!", folderName.c_str()));
+			else if (_stricmp(folderName.c_str(), "_male") != 0 && _stricmp(folderName.c_str(), "_1stperson") != 0)
 			{
-				HandleJson(iter->path());
+				g_jsonFolders.emplace(folderName, path);
+				Log("Found anim folder " + folderName + " which can be used in JSON");
 			}
 		}
 	}
 	else
 	{
-		Log(dir + " does not exist.");
+		Log(GetCurPath() + R"(\Data\Meshes\)" + root + " does not exist.");
 	}
+	ResolveJsonEntries();
 	LoadJsonEntries();
 }
+
+void LoadFileAnimPaths()
+{
+	Log("Loading file anims");
+	const auto root = std::string("AnimGroupOverride");
+	g_animFileTree.Scan(root, GetAnimManifestPath());
+	LoadOverridesFromDisk(root);
+	g_animFileTree.SaveManifest(GetAnimManifestPath());
+}
@@ -1,2 +1,3 @@
 #pragma once
-void LoadFileAnimPaths();
\ No newline at end of file
+void LoadFileAnimPaths();
+void StartJsonLoad();
\ No newline at end of file
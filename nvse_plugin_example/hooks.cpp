@@ -23,7 +23,7 @@ BSAnimGroupSequence* __fastcall HandleAnimationChange(AnimData* animData, void*
 		}
 		// NPCs animGroupId contains 0x8000 for some reason
 		const auto actorAnimGroupId = animGroupId & 0xFFF;
-		if (auto* actorAnim = GetActorAnimation(animData->actor, actorAnimGroupId, firstPerson, animData, toMorph ? toMorph->sequenceName : nullptr))
+		if (auto* actorAnim = GetActorAnimation(animData->actor, actorAnimGroupId, firstPerson, animData, toMorph))
 		{
 			toMorph = actorAnim;
 		}
@@ -1,5 +1,6 @@
 #include "nvse/PluginAPI.h"
 #include "nvse/CommandTable.h"
+#include "anim_sequence_cache.h"
 #include "commands_animation.h"
 #include "hooks.h"
 #include "utility.h"
@@ -12,6 +13,7 @@
 #define RegisterScriptCommand(name) 	nvse->RegisterCommand(&kCommandInfo_ ##name);
 
 IDebugLog		gLog("kNVSE.log");
+NVSEArrayVarInterface* g_arrayInterface = nullptr;
 
 bool NVSEPlugin_Query(const NVSEInterface* nvse, PluginInfo* info)
 {
@@ -63,10 +65,21 @@ bool NVSEPlugin_Load(const NVSEInterface* nvse)
 	RegisterScriptCommand(SetWeaponAnimationPath);
 	RegisterScriptCommand(SetActorAnimationPath);
 	RegisterScriptCommand(PlayAnimationPath);
+	RegisterScriptCommand(SetActorAnimationSeed);
+	RegisterScriptCommand(SetAnimationPathsBatch);
 	ApplyHooks();
 
+	if (!nvse->isEditor)
+		g_arrayInterface = static_cast<NVSEArrayVarInterface*>(nvse->QueryInterface(kInterface_ArrayVar));
+
 	if (!nvse->isEditor)
 	{
+		// parse AnimGroupOverride JSON files while the game loads
+		StartJsonLoad();
+
+		// drops cached classifications of destroyed sequences
+		ApplySequenceCacheHooks();
+
 		// allow diagonal movement in force scripted anims
 		SafeWrite8(0x7E8B1E, 0xEB); // jmp 0x7E8B29
 	}
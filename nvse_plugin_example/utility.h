@@ -30,6 +30,12 @@ inline std::string ReplaceAll(std::string str, const std::string& from, const st
 	return str;
 }
 
+inline std::string ToLower(std::string str)
+{
+	std::transform(str.begin(), str.end(), str.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+	return str;
+}
+
 /// Try to find in the Haystack the Needle - ignore case
 inline bool FindStringCI(const std::string& strHaystack, const std::string& strNeedle)
 {